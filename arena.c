@@ -0,0 +1,60 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void arena_init(arena_t* arena)
+{
+	memset(arena, 0, sizeof(arena_t));
+}
+
+void* arena_alloc(arena_t* arena, size_t size)
+{
+	void* block;
+
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	/* counting pass */
+	if(arena -> base == NULL)
+	{
+		arena -> used += size;
+		return NULL;
+	}
+
+	if(size > arena -> size - arena -> used)
+		return NULL;
+
+	block = arena -> base + arena -> used;
+	arena -> used += size;
+	return block;
+}
+
+int arena_commit(arena_t* arena)
+{
+	void* base;
+	long page_size = sysconf(_SC_PAGESIZE);
+
+	if(arena -> base != NULL)
+		return 1;
+	if(page_size <= 0)
+		page_size = 4096;
+
+	/* an empty arena still gets a block, so that committed means non NULL */
+	if(posix_memalign(&base, page_size, arena -> used ? arena -> used : ARENA_ALIGN) != 0)
+		return 1;
+
+	arena -> base = (char*)base;
+	arena -> size = arena -> used;
+	arena -> used = 0;
+	memset(arena -> base, 0, arena -> size);
+
+	return 0;
+}
+
+void arena_free(arena_t* arena)
+{
+	if(arena -> base != NULL)
+		free(arena -> base);
+	arena_init(arena);
+}
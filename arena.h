@@ -0,0 +1,30 @@
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <stddef.h>
+
+/* single block allocator
+
+	Setup data is carved from one block, sized by running the same carving
+	code twice : arena_alloc() on an arena without memory only adds up the
+	request and returns NULL, arena_commit() then allocates the total and
+	the second run gets the blocks. The block is page aligned and zeroed,
+	so all of it is resident (and locked under mlockall()) before the first
+	cycle. Blocks are aligned to ARENA_ALIGN and are released all at once
+	by arena_free().
+*/
+#define ARENA_ALIGN 16
+
+typedef struct
+{
+	char* base;
+	size_t size;
+	size_t used;
+} arena_t;
+
+void arena_init(arena_t* arena);
+void* arena_alloc(arena_t* arena, size_t size);
+int arena_commit(arena_t* arena);
+void arena_free(arena_t* arena);
+
+#endif
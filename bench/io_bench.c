@@ -0,0 +1,338 @@
+/* io_exchange benchmark on the simulated EtherCAT master
+
+	Every scenario builds a bus on the simulator, maps it through io_mapping()
+	and times io_exchange() for a number of cycles. One JSON object is
+	printed per scenario, so results of different builds can be compared
+	line by line.
+
+	usage : io_bench [-c cycles] [-w warmup] [-d] [-n nodes -r raw -i inputs -o outputs -b bits]
+		-d enables the simulated devices, otherwise only the stack is timed.
+		-n/-r/-i/-o/-b run a single custom scenario.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ecrt_sim.h"
+#include "io.h"
+#include "prof.h"
+
+#define ADDRESS_SIZE 32
+
+typedef struct
+{
+	const char* name;
+	int cia402_count;
+	int raw_count;
+	int input_count;
+	int output_count;
+	int bit_count;
+} scenario_t;
+
+typedef struct
+{
+	io_mapping_info_t* mapping_list;
+	int mapping_count;
+	char* address_list;
+	int* int_list;
+	double* factor_list;
+	char* bit_list;
+
+} mapping_t;
+
+static const scenario_t scenario_list[] =
+{
+	{"cia402-8", 8, 0, 0, 0, 0},
+	{"cia402-32", 32, 0, 0, 0, 0},
+	{"cia402-64", 64, 0, 0, 0, 0},
+	{"raw-byte-16", 0, 16, 0, 0, 0},
+	{"raw-byte-64", 0, 64, 0, 0, 0},
+	{"bit-16x8", 0, 0, 16, 16, 8},
+	{"bit-64x16", 0, 0, 64, 64, 16},
+	{"mixed-64", 64, 0, 16, 16, 8}
+};
+
+/* objects of a generic slave laid out like a simulated drive, but
+	without a control word so that it is not taken for a CiA402 node */
+static ec_pdo_entry_info_t raw_output_entries[] =
+{
+	{0x3000, 0x00, 16}, {0x3001, 0x00, 32}, {0x3002, 0x00, 8}, {0x3003, 0x00, 32}, {0x3004, 0x00, 16}
+};
+static ec_pdo_entry_info_t raw_input_entries[] =
+{
+	{0x3100, 0x00, 16}, {0x3101, 0x00, 32}, {0x3102, 0x00, 8}, {0x3103, 0x00, 32}, {0x3104, 0x00, 16}, {0x3105, 0x00, 32}
+};
+static ec_pdo_info_t raw_output_pdos[] = {{0x1600, 5, raw_output_entries}};
+static ec_pdo_info_t raw_input_pdos[] = {{0x1a00, 6, raw_input_entries}};
+static ec_sync_info_t raw_syncs[] =
+{
+	{2, EC_DIR_OUTPUT, 1, raw_output_pdos, EC_WD_ENABLE},
+	{3, EC_DIR_INPUT, 1, raw_input_pdos, EC_WD_DISABLE}
+};
+
+#define RAW_OUTPUT_COUNT ((int)(sizeof(raw_output_entries) / sizeof(raw_output_entries[0])))
+#define RAW_INPUT_COUNT ((int)(sizeof(raw_input_entries) / sizeof(raw_input_entries[0])))
+#define RAW_OBJECT_COUNT (RAW_OUTPUT_COUNT + RAW_INPUT_COUNT)
+
+static const char* cia402_name_list[] = {"power", "feedback", "target", "factor"};
+
+static int add_raw_slaves(int count);
+static int build_mapping(const scenario_t* scenario, mapping_t* mapping);
+static void free_mapping(mapping_t* mapping);
+static int run_scenario(const scenario_t* scenario, int cycles, int warmup);
+static unsigned long long now_ns(void);
+static int compare_ull(const void* a, const void* b);
+
+int main(int argc, char* argv[])
+{
+	int i, opt;
+	int cycles = 10000;
+	int warmup = 100;
+	int custom = 0;
+	int devices = 0;
+	scenario_t scenario = {"custom", 0, 0, 0, 0, 8};
+
+	while((opt = getopt(argc, argv, "c:w:dn:r:i:o:b:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'c' : cycles = atoi(optarg); break;
+			case 'w' : warmup = atoi(optarg); break;
+			case 'd' : devices = 1; break;
+			case 'n' : scenario.cia402_count = atoi(optarg); custom = 1; break;
+			case 'r' : scenario.raw_count = atoi(optarg); custom = 1; break;
+			case 'i' : scenario.input_count = atoi(optarg); custom = 1; break;
+			case 'o' : scenario.output_count = atoi(optarg); custom = 1; break;
+			case 'b' : scenario.bit_count = atoi(optarg); custom = 1; break;
+			default :
+				fprintf(stderr, "usage : %s [-c cycles] [-w warmup] [-d] [-n nodes -r raw -i inputs -o outputs -b bits]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	if(cycles <= 0)
+		return 1;
+
+	/* measure the stack only unless -d was given */
+	ecrt_sim_set_devices(devices);
+
+	if(custom)
+		return run_scenario(&scenario, cycles, warmup);
+
+	for(i = 0; i < (int)(sizeof(scenario_list) / sizeof(scenario_list[0])); i++)
+	{
+		if(run_scenario(&scenario_list[i], cycles, warmup) != 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+static int run_scenario(const scenario_t* scenario, int cycles, int warmup)
+{
+	int i;
+	mapping_t mapping;
+	io_mapping_report_t report;
+	unsigned long long start;
+	unsigned long long sum = 0;
+	unsigned long long* sample_list;
+	prof_stat_t stat_list[PROF_PHASE_COUNT];
+
+	ecrt_sim_reset();
+	if(ecrt_sim_add_cia402(scenario -> cia402_count) != 0 ||
+		add_raw_slaves(scenario -> raw_count) != 0 ||
+		(scenario -> input_count && ecrt_sim_add_digital_input(scenario -> input_count, scenario -> bit_count) != 0) ||
+		(scenario -> output_count && ecrt_sim_add_digital_output(scenario -> output_count, scenario -> bit_count) != 0))
+	{
+		fprintf(stderr, "%s : building topology failed\n", scenario -> name);
+		return 1;
+	}
+
+	sample_list = (unsigned long long*)malloc(sizeof(unsigned long long) * cycles);
+	if(sample_list == NULL)
+		return 1;
+
+	if(io_init() != 0)
+	{
+		fprintf(stderr, "%s : io_init failed\n", scenario -> name);
+		free(sample_list);
+		return 1;
+	}
+
+	if(build_mapping(scenario, &mapping) != 0 ||
+		io_mapping(mapping.mapping_list, mapping.mapping_count) != 0 ||
+		io_mapping_report(&report) != 0 ||
+		io_activate(250000) != 0)
+	{
+		fprintf(stderr, "%s : mapping failed\n", scenario -> name);
+		free_mapping(&mapping);
+		io_cleanup();
+		free(sample_list);
+		return 1;
+	}
+
+	for(i = 0; i < warmup; i++)
+		io_exchange();
+
+	prof_reset();
+	for(i = 0; i < cycles; i++)
+	{
+		start = now_ns();
+		io_exchange();
+		sample_list[i] = now_ns() - start;
+		sum += sample_list[i];
+	}
+
+	qsort(sample_list, cycles, sizeof(unsigned long long), compare_ull);
+
+	printf("{\"scenario\":\"%s\",\"slaves\":%d,\"cia402_nodes\":%d,\"entries\":%d,"
+		"\"byte_entries\":%d,\"bit_entries\":%d,\"cycles\":%d,"
+		"\"mean_ns\":%llu,\"p50_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu",
+		scenario -> name, ecrt_sim_slave_count(), scenario -> cia402_count, report.entry_count,
+		report.entry_count - report.bit_entry_count, report.bit_entry_count, cycles,
+		sum / cycles, sample_list[cycles / 2], sample_list[(int)((cycles - 1) * 0.99)], sample_list[cycles - 1]);
+
+	/* phase breakdown is only available in IO_PROFILE builds */
+	if(prof_get(stat_list, PROF_PHASE_COUNT) == 0)
+	{
+		printf(",\"phases\":{");
+		for(i = 0; i < PROF_PHASE_COUNT; i++)
+		{
+			printf("%s\"%s\":{\"mean_ns\":%llu,\"max_ns\":%llu}", i ? "," : "", prof_phase_name(i),
+				stat_list[i].count ? stat_list[i].sum / stat_list[i].count : 0, stat_list[i].max);
+		}
+		printf("}");
+	}
+	printf("}\n");
+	fflush(stdout);
+
+	io_cleanup();
+	free_mapping(&mapping);
+	free(sample_list);
+
+	return 0;
+}
+
+static int build_mapping(const scenario_t* scenario, mapping_t* mapping)
+{
+	int i, j, k;
+	int position = 0;
+	int count;
+	io_mapping_info_t* info;
+	const ec_pdo_entry_info_t* entry;
+
+	memset(mapping, 0, sizeof(mapping_t));
+
+	count = scenario -> cia402_count * 4 + scenario -> raw_count * RAW_OBJECT_COUNT +
+		(scenario -> input_count + scenario -> output_count) * scenario -> bit_count;
+
+	mapping -> mapping_list = (io_mapping_info_t*)calloc(count + 1, sizeof(io_mapping_info_t));
+	mapping -> address_list = (char*)calloc(count + 1, ADDRESS_SIZE);
+	mapping -> int_list = (int*)calloc(count + 1, sizeof(int));
+	mapping -> factor_list = (double*)calloc(scenario -> cia402_count + 1, sizeof(double));
+	mapping -> bit_list = (char*)calloc(count + 1, 1);
+	if(mapping -> mapping_list == NULL || mapping -> address_list == NULL || mapping -> int_list == NULL ||
+		mapping -> factor_list == NULL || mapping -> bit_list == NULL)
+		return 1;
+
+	k = 0;
+	for(i = 0; i < scenario -> cia402_count; i++, position++)
+	{
+		for(j = 0; j < 4; j++, k++)
+		{
+			info = &(mapping -> mapping_list[k]);
+			info -> network_addr = mapping -> address_list + k * ADDRESS_SIZE;
+			snprintf(info -> network_addr, ADDRESS_SIZE, "%d:%s", position, cia402_name_list[j]);
+			info -> direction = j == 1;
+			info -> mode = IO_MAPPING_COPY;
+			if(j == 3)
+			{
+				mapping -> factor_list[i] = 1.5;
+				info -> model_addr = &(mapping -> factor_list[i]);
+				info -> size = sizeof(double);
+			}
+			else
+			{
+				info -> model_addr = &(mapping -> int_list[k]);
+				info -> size = sizeof(int);
+				mapping -> int_list[k] = j == 0 ? 1 : 1000 + i;
+			}
+		}
+	}
+
+	for(i = 0; i < scenario -> raw_count; i++, position++)
+	{
+		for(j = 0; j < RAW_OBJECT_COUNT; j++, k++)
+		{
+			info = &(mapping -> mapping_list[k]);
+			info -> network_addr = mapping -> address_list + k * ADDRESS_SIZE;
+			entry = j < RAW_OUTPUT_COUNT ? &raw_output_entries[j] : &raw_input_entries[j - RAW_OUTPUT_COUNT];
+			snprintf(info -> network_addr, ADDRESS_SIZE, "%d:0x%x:0x0", position, entry -> index);
+			info -> model_addr = &(mapping -> int_list[k]);
+			info -> size = entry -> bit_length / 8;
+			info -> direction = j >= RAW_OUTPUT_COUNT;
+			info -> mode = IO_MAPPING_COPY;
+		}
+	}
+
+	for(i = 0; i < scenario -> input_count + scenario -> output_count; i++, position++)
+	{
+		for(j = 0; j < scenario -> bit_count; j++, k++)
+		{
+			info = &(mapping -> mapping_list[k]);
+			info -> network_addr = mapping -> address_list + k * ADDRESS_SIZE;
+			snprintf(info -> network_addr, ADDRESS_SIZE, "%d:0x%x:0x1", position,
+				(i < scenario -> input_count ? 0x6000 : 0x7000) + j * 0x10);
+			info -> model_addr = &(mapping -> bit_list[k]);
+			info -> size = 1;
+			info -> direction = i < scenario -> input_count;
+			info -> mode = IO_MAPPING_COPY;
+		}
+	}
+
+	mapping -> mapping_count = k;
+
+	return 0;
+}
+
+static int add_raw_slaves(int count)
+{
+	int i;
+
+	for(i = 0; i < count; i++)
+	{
+		if(ecrt_sim_add_slave(ECRT_SIM_VENDOR_ID, 0x00003000, "Simulated raw slave", ECRT_SIM_GENERIC,
+			raw_syncs, sizeof(raw_syncs) / sizeof(raw_syncs[0])) != 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+static void free_mapping(mapping_t* mapping)
+{
+	free(mapping -> mapping_list);
+	free(mapping -> address_list);
+	free(mapping -> int_list);
+	free(mapping -> factor_list);
+	free(mapping -> bit_list);
+	memset(mapping, 0, sizeof(mapping_t));
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int compare_ull(const void* a, const void* b)
+{
+	unsigned long long value_a = *(const unsigned long long*)a;
+	unsigned long long value_b = *(const unsigned long long*)b;
+
+	return value_a < value_b ? -1 : value_a > value_b;
+}
@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "io.h"
+#include "ecrt_sim.h"
+
+/* copy program check
+
+	Runs io_exchange() on the simulated bus with slaves whose PDOs mix 8,
+	16 and 32 bit entries with single bits sharing a byte, and compares
+	every output object of the simulator with the model and every input
+	variable of the model with the object it was received from. The
+	first three entries of each direction are adjacent in the model as
+	in the domain, so they are copied as one block.
+
+	program_check [slaves] [cycles]
+*/
+#define ENTRY_COUNT 22
+#define OUTPUT_INDEX 0x3000
+#define INPUT_INDEX 0x3100
+
+static const int width_list[ENTRY_COUNT] =
+	{8, 16, 32, 1, 1, 1, 1, 1, 1, 1, 1, 16, 1, 1, 1, 1, 1, 1, 1, 1, 8, 32};
+
+typedef struct
+{
+	uint8_t block[7];
+	char bit[16];
+	int32_t word;
+	uint8_t byte;
+	uint32_t dword;
+} image_t;
+
+static int slave_count = 4;
+static int cycle_count = 10000;
+
+static image_t* output_list = NULL;
+static image_t* input_list = NULL;
+
+static int add_slaves(void);
+static void* entry_addr(image_t* image, int entry, int* size);
+static uint32_t get_entry(image_t* image, int entry);
+static void set_entry(image_t* image, int entry, uint32_t value);
+static uint32_t mask_of(int entry);
+
+int main(int argc, char** argv)
+{
+	int i, j, k, n;
+	int mapping_count;
+	int size;
+	int fail = 0;
+	long long checks = 0;
+	int64_t value;
+	uint32_t* sent;
+	io_mapping_info_t* mapping_list;
+	char (*addr_list)[32];
+
+	if(argc > 1)
+		slave_count = atoi(argv[1]);
+	if(argc > 2)
+		cycle_count = atoi(argv[2]);
+	if(slave_count <= 0 || cycle_count <= 0)
+	{
+		printf("usage: %s [slaves] [cycles]\n", argv[0]);
+		return 1;
+	}
+
+	srand(1);
+
+	if(add_slaves() != 0)
+	{
+		printf("EtherCAT simulated topology failed!\n");
+		return 1;
+	}
+
+	mapping_count = slave_count * ENTRY_COUNT * 2;
+	output_list = (image_t*)calloc(slave_count, sizeof(image_t));
+	input_list = (image_t*)calloc(slave_count, sizeof(image_t));
+	sent = (uint32_t*)calloc(slave_count * ENTRY_COUNT, sizeof(uint32_t));
+	mapping_list = (io_mapping_info_t*)calloc(mapping_count, sizeof(io_mapping_info_t));
+	addr_list = calloc(mapping_count, sizeof(*addr_list));
+	if(output_list == NULL || input_list == NULL || sent == NULL || mapping_list == NULL || addr_list == NULL)
+		return 1;
+
+	for(i = 0, n = 0; i < slave_count; i++)
+	{
+		for(j = 0; j < ENTRY_COUNT; j++)
+		{
+			for(k = 0; k < 2; k++, n++)
+			{
+				mapping_list[n].model_addr = entry_addr(k ? &input_list[i] : &output_list[i], j, &size);
+				mapping_list[n].size = size;
+				mapping_list[n].direction = k;
+				mapping_list[n].mode = IO_MAPPING_COPY;
+				snprintf(addr_list[n], sizeof(addr_list[n]), "%d:0x%x:0x0", i,
+					(k ? INPUT_INDEX : OUTPUT_INDEX) + j);
+				mapping_list[n].network_addr = addr_list[n];
+			}
+		}
+	}
+
+	if(io_init() != 0 || io_mapping(mapping_list, mapping_count) != 0 || io_activate(1000000) != 0)
+	{
+		printf("EtherCAT program check setup failed!\n");
+		return 1;
+	}
+
+	for(n = 0; n < cycle_count && fail == 0; n++)
+	{
+		for(i = 0; i < slave_count; i++)
+		{
+			for(j = 0; j < ENTRY_COUNT; j++)
+			{
+				set_entry(&output_list[i], j, (uint32_t)rand() ^ ((uint32_t)rand() << 16));
+				sent[i * ENTRY_COUNT + j] = (uint32_t)rand() ^ ((uint32_t)rand() << 16);
+				ecrt_sim_write_object(i, INPUT_INDEX + j, 0, sent[i * ENTRY_COUNT + j] & mask_of(j));
+			}
+		}
+
+		if(io_exchange() != 0)
+		{
+			printf("EtherCAT exchange failed!\n");
+			return 1;
+		}
+
+		for(i = 0; i < slave_count && fail == 0; i++)
+		{
+			for(j = 0; j < ENTRY_COUNT; j++)
+			{
+				if(ecrt_sim_read_object(i, OUTPUT_INDEX + j, 0, &value) != 0 ||
+					(uint32_t)value != get_entry(&output_list[i], j))
+				{
+					printf("output mismatch: cycle %d slave %d entry 0x%04x: 0x%08x != 0x%08x\n", n, i,
+						OUTPUT_INDEX + j, (uint32_t)value, get_entry(&output_list[i], j));
+					fail = 1;
+					break;
+				}
+
+				/* the inputs of the first cycle were set before any frame went out */
+				if(n > 0 && get_entry(&input_list[i], j) != (sent[i * ENTRY_COUNT + j] & mask_of(j)))
+				{
+					printf("input mismatch: cycle %d slave %d entry 0x%04x: 0x%08x != 0x%08x\n", n, i,
+						INPUT_INDEX + j, get_entry(&input_list[i], j), sent[i * ENTRY_COUNT + j] & mask_of(j));
+					fail = 1;
+					break;
+				}
+
+				checks += 2;
+			}
+		}
+	}
+
+	io_cleanup();
+
+	printf("{\"slaves\": %d, \"cycles\": %d, \"checks\": %lld, \"result\": \"%s\"}\n",
+		slave_count, n, checks, fail ? "fail" : "pass");
+
+	free(output_list);
+	free(input_list);
+	free(sent);
+	free(mapping_list);
+	free(addr_list);
+
+	return fail;
+}
+
+static int add_slaves(void)
+{
+	int i;
+	ec_pdo_entry_info_t output_entries[ENTRY_COUNT];
+	ec_pdo_entry_info_t input_entries[ENTRY_COUNT];
+	ec_pdo_info_t output_pdos[] = {{0x1600, ENTRY_COUNT, output_entries}};
+	ec_pdo_info_t input_pdos[] = {{0x1a00, ENTRY_COUNT, input_entries}};
+	ec_sync_info_t syncs[] =
+	{
+		{0, EC_DIR_OUTPUT, 1, output_pdos, EC_WD_ENABLE},
+		{1, EC_DIR_INPUT, 1, input_pdos, EC_WD_DISABLE}
+	};
+
+	for(i = 0; i < ENTRY_COUNT; i++)
+	{
+		output_entries[i].index = OUTPUT_INDEX + i;
+		output_entries[i].subindex = 0x00;
+		output_entries[i].bit_length = width_list[i];
+		input_entries[i].index = INPUT_INDEX + i;
+		input_entries[i].subindex = 0x00;
+		input_entries[i].bit_length = width_list[i];
+	}
+
+	ecrt_sim_reset();
+	for(i = 0; i < slave_count; i++)
+	{
+		if(ecrt_sim_add_slave(ECRT_SIM_VENDOR_ID, 0x00003000, "Simulated mixed slave", ECRT_SIM_GENERIC,
+			syncs, 2) != 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+/* entries 0 to 2 are packed in block, 11 is widened into a 32 bit variable */
+static void* entry_addr(image_t* image, int entry, int* size)
+{
+	switch(entry)
+	{
+	case 0:
+		*size = 1;
+		return &image -> block[0];
+	case 1:
+		*size = 2;
+		return &image -> block[1];
+	case 2:
+		*size = 4;
+		return &image -> block[3];
+	case 11:
+		*size = 4;
+		return &image -> word;
+	case 20:
+		*size = 1;
+		return &image -> byte;
+	case 21:
+		*size = 4;
+		return &image -> dword;
+	}
+
+	*size = 1;
+	return &image -> bit[entry < 11 ? entry - 3 : entry - 4];
+}
+
+static uint32_t get_entry(image_t* image, int entry)
+{
+	int size;
+	uint8_t* p = (uint8_t*)entry_addr(image, entry, &size);
+	uint32_t value = 0;
+
+	if(width_list[entry] == 1)
+		return *p ? 1 : 0;
+
+	memcpy(&value, p, width_list[entry] / 8);
+	return value;
+}
+
+static void set_entry(image_t* image, int entry, uint32_t value)
+{
+	int size;
+	uint8_t* p = (uint8_t*)entry_addr(image, entry, &size);
+
+	if(width_list[entry] == 1)
+		*p = value & 1;
+	else
+		memcpy(p, &value, width_list[entry] / 8);
+}
+
+static uint32_t mask_of(int entry)
+{
+	return width_list[entry] == 32 ? 0xffffffff : (1u << width_list[entry]) - 1;
+}
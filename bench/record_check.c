@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "io.h"
+#include "ecrt_sim.h"
+#include "recorder.h"
+
+/* process data recorder check
+
+	Records cycles of a simulated slave and decodes the file with the
+	reader of recorder.h. Every decoded value must equal the process data
+	of its cycle, taken from the model variables that the copy program
+	exchanged in the same cycle, and the cycle count must advance by one
+	per row with no row dropped. The columns cover full range 32 bit jumps
+	that wrap around, a 16 bit walk crossing zero, bytes, single bits, a
+	constant and received inputs, over enough rows to span several blocks
+	and end in a partial one.
+
+	record_check [cycles] [path]
+*/
+#define OUTPUT_INDEX 0x3000
+#define INPUT_INDEX 0x3100
+#define OUTPUT_COUNT 13
+#define INPUT_COUNT 2
+#define COLUMN_COUNT (OUTPUT_COUNT + INPUT_COUNT)
+
+static const int output_width_list[OUTPUT_COUNT] = {32, 16, 8, 1, 1, 1, 1, 1, 1, 1, 1, 32, 16};
+static const int input_width_list[INPUT_COUNT] = {32, 16};
+
+static uint32_t output_list[OUTPUT_COUNT];
+static uint32_t input_list[INPUT_COUNT];
+
+static int add_slave(void);
+static uint32_t get_random(void);
+static uint32_t get_mask(int bit_length);
+
+int main(int argc, char** argv)
+{
+	int i, c, r, n;
+	int cycle_count = 5000;
+	int depth = 1;
+	int mismatch = 0;
+	int block_count = 0;
+	int row = 0;
+	const char* path = "/tmp/record_check.rec";
+	uint32_t* expected;
+	unsigned long long first_cycle = 0;
+	io_mapping_info_t mapping_list[COLUMN_COUNT];
+	io_addr_t addr_list[COLUMN_COUNT];
+	char address_list[COLUMN_COUNT][32];
+	recorder_reader_t reader;
+
+	if(argc > 1)
+		cycle_count = atoi(argv[1]);
+	if(argc > 2)
+		path = argv[2];
+	if(cycle_count <= 0)
+	{
+		printf("usage: %s [cycles] [path]\n", argv[0]);
+		return 1;
+	}
+
+	/* the ring holds the whole recording, so no row may be dropped */
+	while(depth < cycle_count)
+		depth <<= 1;
+
+	expected = (uint32_t*)malloc(sizeof(uint32_t) * COLUMN_COUNT * cycle_count);
+	if(expected == NULL || add_slave() != 0)
+	{
+		printf("EtherCAT simulated topology failed!\n");
+		return 1;
+	}
+
+	memset(mapping_list, 0, sizeof(mapping_list));
+	memset(addr_list, 0, sizeof(addr_list));
+	for(c = 0; c < COLUMN_COUNT; c++)
+	{
+		n = c < OUTPUT_COUNT ? OUTPUT_INDEX + c : INPUT_INDEX + c - OUTPUT_COUNT;
+		snprintf(address_list[c], sizeof(address_list[c]), "0:0x%x:0x0", n);
+		mapping_list[c].network_addr = address_list[c];
+		mapping_list[c].model_addr = c < OUTPUT_COUNT ? &output_list[c] : &input_list[c - OUTPUT_COUNT];
+		mapping_list[c].size = 4;
+		mapping_list[c].direction = c >= OUTPUT_COUNT;
+		mapping_list[c].mode = IO_MAPPING_COPY;
+
+		addr_list[c].slave = 0;
+		addr_list[c].index = n;
+		addr_list[c].role = IO_ROLE_OBJECT;
+	}
+
+	if(io_init() != 0 || io_mapping(mapping_list, COLUMN_COUNT) != 0 || io_activate(1000000) != 0 ||
+		io_record_start(path, addr_list, COLUMN_COUNT, depth) != 0)
+	{
+		printf("EtherCAT record check setup failed!\n");
+		return 1;
+	}
+
+	srand(1);
+	for(i = 0; i < cycle_count; i++)
+	{
+		/* a full range jump wraps the 32 bit difference, the walk crosses zero */
+		output_list[0] += get_random();
+		output_list[1] = (output_list[1] + (rand() % 6001) - 3000) & 0xffff;
+		output_list[2] = rand() & 0xff;
+		for(c = 3; c < 11; c++)
+			output_list[c] = i % (c - 1) == 0 ? !output_list[c] : output_list[c];
+		output_list[11] = get_random();
+		output_list[12] = 0x1234;
+
+		ecrt_sim_write_object(0, INPUT_INDEX, 0, (uint32_t)(i * 0x10001) ^ get_random() >> (i % 32));
+		ecrt_sim_write_object(0, INPUT_INDEX + 1, 0, (uint16_t)(-i * 7));
+
+		if(io_exchange() != 0)
+		{
+			printf("EtherCAT exchange failed!\n");
+			return 1;
+		}
+
+		/* the process data of this cycle, as the copy program saw it */
+		for(c = 0; c < OUTPUT_COUNT; c++)
+			expected[i * COLUMN_COUNT + c] = output_list[c] & get_mask(output_width_list[c]);
+		for(c = 0; c < INPUT_COUNT; c++)
+			expected[i * COLUMN_COUNT + OUTPUT_COUNT + c] = input_list[c] & get_mask(input_width_list[c]);
+	}
+
+	if(io_record_stop() != 0)
+	{
+		printf("EtherCAT stopping the recorder failed!\n");
+		return 1;
+	}
+	io_cleanup();
+
+	if(recorder_open(&reader, path) != 0)
+	{
+		printf("opening %s failed!\n", path);
+		return 1;
+	}
+
+	if(reader.header.column_count != COLUMN_COUNT || reader.header.row_count != (uint64_t)cycle_count ||
+		reader.header.dropped != 0)
+	{
+		printf("header: %u columns, %llu rows, %llu dropped\n", reader.header.column_count,
+			(unsigned long long)reader.header.row_count, (unsigned long long)reader.header.dropped);
+		mismatch++;
+	}
+
+	while(mismatch == 0 && (n = recorder_read_block(&reader)) > 0)
+	{
+		block_count++;
+		for(r = 0; r < n && mismatch == 0; r++, row++)
+		{
+			if(row == 0)
+				first_cycle = reader.cycle_list[r];
+			if(row >= cycle_count || reader.cycle_list[r] != first_cycle + row)
+			{
+				printf("row %d: cycle %llu\n", row, reader.cycle_list[r]);
+				mismatch++;
+				break;
+			}
+
+			for(c = 0; c < COLUMN_COUNT; c++)
+			{
+				if(reader.value_list[c][r] != expected[row * COLUMN_COUNT + c])
+				{
+					printf("row %d column %d (0x%04x): 0x%08x != 0x%08x\n", row, c, reader.entry_list[c].index,
+						reader.value_list[c][r], expected[row * COLUMN_COUNT + c]);
+					mismatch++;
+					break;
+				}
+			}
+		}
+	}
+	if(n < 0 || (mismatch == 0 && row != cycle_count))
+	{
+		printf("decoded %d of %d rows\n", row, cycle_count);
+		mismatch++;
+	}
+
+	recorder_close(&reader);
+	unlink(path);
+	free(expected);
+
+	printf("{\"cycles\": %d, \"columns\": %d, \"blocks\": %d, \"result\": \"%s\"}\n",
+		cycle_count, COLUMN_COUNT, block_count, mismatch ? "fail" : "pass");
+
+	return mismatch != 0;
+}
+
+static int add_slave(void)
+{
+	int i;
+	ec_pdo_entry_info_t output_entries[OUTPUT_COUNT];
+	ec_pdo_entry_info_t input_entries[INPUT_COUNT];
+	ec_pdo_info_t output_pdos[] = {{0x1600, OUTPUT_COUNT, output_entries}};
+	ec_pdo_info_t input_pdos[] = {{0x1a00, INPUT_COUNT, input_entries}};
+	ec_sync_info_t syncs[] =
+	{
+		{0, EC_DIR_OUTPUT, 1, output_pdos, EC_WD_ENABLE},
+		{1, EC_DIR_INPUT, 1, input_pdos, EC_WD_DISABLE}
+	};
+
+	for(i = 0; i < OUTPUT_COUNT; i++)
+	{
+		output_entries[i].index = OUTPUT_INDEX + i;
+		output_entries[i].subindex = 0x00;
+		output_entries[i].bit_length = output_width_list[i];
+	}
+	for(i = 0; i < INPUT_COUNT; i++)
+	{
+		input_entries[i].index = INPUT_INDEX + i;
+		input_entries[i].subindex = 0x00;
+		input_entries[i].bit_length = input_width_list[i];
+	}
+
+	ecrt_sim_reset();
+	return ecrt_sim_add_slave(ECRT_SIM_VENDOR_ID, 0x00003000, "Simulated recorded slave", ECRT_SIM_GENERIC, syncs, 2);
+}
+
+static uint32_t get_random(void)
+{
+	return (uint32_t)rand() ^ ((uint32_t)rand() << 16);
+}
+
+static uint32_t get_mask(int bit_length)
+{
+	return bit_length == 32 ? 0xffffffffU : (1U << bit_length) - 1;
+}
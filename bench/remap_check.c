@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "io.h"
+#include "ecrt_sim.h"
+
+/* online remapping check
+
+	A cycle thread runs io_receive() and io_send() on the simulated bus
+	while the main thread switches with io_remap() between two sets of
+	bindings over the same registered entries. Slave 0 exchanges 32 bit
+	objects every cycle, slave 1 in rate group 2. Every cycle writes the
+	cycle number to all input objects and all output variables, so the
+	objects a cycle updated tell which bindings it ran. A cycle must have
+	run one set completely, in both directions and in both domains, no
+	cycle may run the old set once io_remap() returned and the new set
+	must then carry the data.
+
+	remap_check [remaps]
+*/
+#define SET_SIZE 4
+#define SLOW_SET_SIZE 2
+#define OUTPUT_INDEX 0x3000
+#define INPUT_INDEX 0x3100
+#define WAIT_US 200000
+
+#define SET_MIXED -1
+#define SET_A 0
+#define SET_B 1
+
+static int32_t output_list[2][SET_SIZE];
+static int32_t slow_output_list[2][SLOW_SET_SIZE];
+static int32_t input_list[2][SET_SIZE];
+
+static int run = 1;
+static int active_set = SET_MIXED;
+static int expected_set = SET_A;
+static long long cycle_count = 0;
+static long long mixed_count = 0;
+static long long stale_count = 0;
+
+static int add_slaves(void);
+static void set_mapping(io_mapping_info_t* mapping, char* address, int slave, int index,
+	void* model_addr, int direction, int rate_group);
+static int build_mapping(io_mapping_info_t* mapping_list, char (*address_list)[32], int set, int reserve);
+static int get_set(const int32_t* value_list, int size, int32_t cycle);
+static int get_object_set(int slave, int index, int size, int32_t cycle);
+static void* cycle_task(void* arg);
+
+int main(int argc, char** argv)
+{
+	int i, set, mapping_count;
+	int remap_count = 500;
+	int fail = 0;
+	long long wait;
+	pthread_t thread;
+	io_mapping_info_t mapping_list[(SET_SIZE * 2 + SLOW_SET_SIZE) * 2];
+	char address_list[(SET_SIZE * 2 + SLOW_SET_SIZE) * 2][32];
+
+	if(argc > 1)
+		remap_count = atoi(argv[1]);
+	if(remap_count <= 0)
+	{
+		printf("usage: %s [remaps]\n", argv[0]);
+		return 1;
+	}
+
+	if(add_slaves() != 0)
+	{
+		printf("EtherCAT simulated topology failed!\n");
+		return 1;
+	}
+
+	/* set A is bound, set B only registered */
+	mapping_count = build_mapping(mapping_list, address_list, SET_A, 1);
+	if(io_init() != 0 || io_mapping(mapping_list, mapping_count) != 0 || io_activate(1000000) != 0)
+	{
+		printf("EtherCAT remap check setup failed!\n");
+		return 1;
+	}
+
+	if(pthread_create(&thread, NULL, cycle_task, NULL) != 0)
+		return 1;
+
+	set = SET_A;
+	for(i = 0; i <= remap_count && fail == 0; i++)
+	{
+		if(i > 0)
+		{
+			set = !set;
+			mapping_count = build_mapping(mapping_list, address_list, set, 0);
+			__atomic_store_n(&expected_set, SET_MIXED, __ATOMIC_RELEASE);
+			if(io_remap(mapping_list, mapping_count) != 0)
+			{
+				printf("remap %d failed\n", i);
+				fail = 1;
+				break;
+			}
+			__atomic_store_n(&expected_set, set, __ATOMIC_RELEASE);
+		}
+
+		/* the next full cycle must run the new bindings */
+		for(wait = 0; wait < WAIT_US && __atomic_load_n(&active_set, __ATOMIC_ACQUIRE) != set; wait += 100)
+			usleep(100);
+		if(__atomic_load_n(&active_set, __ATOMIC_ACQUIRE) != set)
+		{
+			printf("remap %d: set %c carries no data\n", i, 'A' + set);
+			fail = 1;
+		}
+	}
+
+	__atomic_store_n(&run, 0, __ATOMIC_RELEASE);
+	pthread_join(thread, NULL);
+	io_cleanup();
+
+	if(mixed_count != 0 || stale_count != 0)
+		fail = 1;
+
+	printf("{\"remaps\": %d, \"cycles\": %lld, \"mixed_cycles\": %lld, \"stale_cycles\": %lld, \"result\": \"%s\"}\n",
+		i > remap_count ? remap_count : i, cycle_count, mixed_count, stale_count, fail ? "fail" : "pass");
+
+	return fail;
+}
+
+static int add_slaves(void)
+{
+	int i;
+	ec_pdo_entry_info_t output_entries[SET_SIZE * 2];
+	ec_pdo_entry_info_t input_entries[SET_SIZE * 2];
+	ec_pdo_info_t output_pdos[] = {{0x1600, SET_SIZE * 2, output_entries}};
+	ec_pdo_info_t input_pdos[] = {{0x1a00, SET_SIZE * 2, input_entries}};
+	ec_pdo_info_t slow_pdos[] = {{0x1600, SLOW_SET_SIZE * 2, output_entries}};
+	ec_sync_info_t syncs[] =
+	{
+		{0, EC_DIR_OUTPUT, 1, output_pdos, EC_WD_ENABLE},
+		{1, EC_DIR_INPUT, 1, input_pdos, EC_WD_DISABLE}
+	};
+	ec_sync_info_t slow_syncs[] =
+	{
+		{0, EC_DIR_OUTPUT, 1, slow_pdos, EC_WD_ENABLE}
+	};
+
+	for(i = 0; i < SET_SIZE * 2; i++)
+	{
+		output_entries[i].index = OUTPUT_INDEX + i;
+		output_entries[i].subindex = 0x00;
+		output_entries[i].bit_length = 32;
+		input_entries[i].index = INPUT_INDEX + i;
+		input_entries[i].subindex = 0x00;
+		input_entries[i].bit_length = 32;
+	}
+
+	ecrt_sim_reset();
+	if(ecrt_sim_add_slave(ECRT_SIM_VENDOR_ID, 0x00003000, "Simulated remap slave", ECRT_SIM_GENERIC, syncs, 2) != 0 ||
+		ecrt_sim_add_slave(ECRT_SIM_VENDOR_ID, 0x00003001, "Simulated slow slave", ECRT_SIM_GENERIC, slow_syncs, 1) != 0)
+		return 1;
+
+	return 0;
+}
+
+static void set_mapping(io_mapping_info_t* mapping, char* address, int slave, int index,
+	void* model_addr, int direction, int rate_group)
+{
+	memset(mapping, 0, sizeof(io_mapping_info_t));
+	snprintf(address, 32, "%d:0x%x:0x0", slave, index);
+	mapping -> network_addr = address;
+	mapping -> model_addr = model_addr;
+	mapping -> size = model_addr != NULL ? 4 : 0;
+	mapping -> direction = direction;
+	mapping -> mode = IO_MAPPING_COPY;
+	mapping -> rate_group = rate_group;
+}
+
+/* entries of set, and with reserve those of the other set without a variable */
+static int build_mapping(io_mapping_info_t* mapping_list, char (*address_list)[32], int set, int reserve)
+{
+	int i, s;
+	int count = 0;
+
+	for(s = 0; s < 2; s++)
+	{
+		if(s != set && !reserve)
+			continue;
+
+		for(i = 0; i < SET_SIZE; i++, count++)
+			set_mapping(&mapping_list[count], address_list[count], 0, OUTPUT_INDEX + s * SET_SIZE + i,
+				s == set ? &output_list[s][i] : NULL, 0, 0);
+		for(i = 0; i < SET_SIZE; i++, count++)
+			set_mapping(&mapping_list[count], address_list[count], 0, INPUT_INDEX + s * SET_SIZE + i,
+				s == set ? &input_list[s][i] : NULL, 1, 0);
+		for(i = 0; i < SLOW_SET_SIZE; i++, count++)
+			set_mapping(&mapping_list[count], address_list[count], 1, OUTPUT_INDEX + s * SLOW_SET_SIZE + i,
+				s == set ? &slow_output_list[s][i] : NULL, 0, 2);
+	}
+
+	return count;
+}
+
+/* which set got the value of this cycle, values of both sets follow each other */
+static int get_set(const int32_t* value_list, int size, int32_t cycle)
+{
+	int i;
+	int updated[2] = {0, 0};
+
+	for(i = 0; i < size * 2; i++)
+		updated[i / size] += value_list[i] == cycle;
+
+	if(updated[SET_A] == size && updated[SET_B] == 0)
+		return SET_A;
+	if(updated[SET_B] == size && updated[SET_A] == 0)
+		return SET_B;
+
+	return SET_MIXED;
+}
+
+static int get_object_set(int slave, int index, int size, int32_t cycle)
+{
+	int i;
+	int64_t value;
+	int32_t value_list[SET_SIZE * 2];
+
+	for(i = 0; i < size * 2; i++)
+	{
+		if(ecrt_sim_read_object(slave, index + i, 0, &value) != 0)
+			return SET_MIXED;
+		value_list[i] = (int32_t)value;
+	}
+
+	return get_set(value_list, size, cycle);
+}
+
+static void* cycle_task(void* arg)
+{
+	int i, set, input_set, slow_set, expected;
+	int last_set = SET_MIXED;
+	int32_t cycle;
+	int32_t value_list[SET_SIZE * 2];
+
+	for(cycle = 1; __atomic_load_n(&run, __ATOMIC_ACQUIRE); cycle++)
+	{
+		for(i = 0; i < SET_SIZE * 2; i++)
+			ecrt_sim_write_object(0, INPUT_INDEX + i, 0, cycle);
+
+		io_receive();
+
+		for(i = 0; i < SET_SIZE * 2; i++)
+			value_list[i] = input_list[i / SET_SIZE][i % SET_SIZE];
+		input_set = get_set(value_list, SET_SIZE, cycle);
+
+		for(i = 0; i < SET_SIZE; i++)
+		{
+			output_list[SET_A][i] = cycle;
+			output_list[SET_B][i] = cycle;
+		}
+		for(i = 0; i < SLOW_SET_SIZE; i++)
+		{
+			slow_output_list[SET_A][i] = cycle;
+			slow_output_list[SET_B][i] = cycle;
+		}
+
+		io_send();
+
+		/* the inputs of the first cycle were not sent yet, rate group 2 runs on odd cycles */
+		set = get_object_set(0, OUTPUT_INDEX, SET_SIZE, cycle);
+		slow_set = cycle % 2 ? get_object_set(1, OUTPUT_INDEX, SLOW_SET_SIZE, cycle) : set;
+		if(cycle == 1)
+			input_set = set;
+
+		if(set == SET_MIXED || set != input_set || set != slow_set)
+		{
+			printf("cycle %d ran a mixed mapping (outputs %d, inputs %d, slow outputs %d)\n",
+				cycle, set, input_set, slow_set);
+			mixed_count++;
+		}
+		else
+		{
+			expected = __atomic_load_n(&expected_set, __ATOMIC_ACQUIRE);
+			if(expected != SET_MIXED && set != expected)
+			{
+				printf("cycle %d ran set %c after the remap to set %c returned\n", cycle, 'A' + set, 'A' + expected);
+				stale_count++;
+			}
+			if(set != last_set)
+			{
+				__atomic_store_n(&active_set, set, __ATOMIC_RELEASE);
+				last_set = set;
+			}
+		}
+		cycle_count++;
+
+		usleep(50);
+	}
+
+	return NULL;
+}
@@ -0,0 +1,157 @@
+/* CIA402_FIXED_SCALE rounding check
+
+	Runs cia402_scale_q() over boundary and pseudo-random values with
+	negative, fractional, large and non-binary factors and compares every
+	result with the double path, (int)(value * factor). Products outside
+	the int range are skipped, the double path is undefined there.
+
+	A factor that is a multiple of 2^-32 must give the same result. Any
+	other factor may differ by one count, and only where value * factor
+	lies within |value| * 2^-33 of an integer (see cia402.h). NaN and
+	infinite factors must be rejected by cia402_factor_to_q().
+
+	usage : scale_check [-n random values]
+	The exit status is 1 on any mismatch.
+*/
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "cia402.h"
+
+static const int value_list[] =
+{
+	0, 1, -1, 2, -2, 3, -3, 7, -7, 127, -128, 255, 32767, -32768, 65535, -65536,
+	1000000, -1000000, 1 << 20, -(1 << 20), 1 << 30, -(1 << 30),
+	INT_MAX, INT_MAX - 1, INT_MIN, INT_MIN + 1
+};
+
+/* multiples of 2^-32 */
+static const double exact_factor_list[] =
+{
+	0.0, 1.0, -1.0, 2.0, -2.0, 3.0, 0.5, -0.5, 2.5, -2.5, 0.125, 0.75, -0.375,
+	1.0 / 1024, 1024.0, -65536.0, 1000.0, 131072.0, 1.0 / 4294967296.0, -1.0 / 4294967296.0
+};
+
+static const double inexact_factor_list[] =
+{
+	0.1, -0.1, 1.0 / 3, -2.0 / 3, 0.001, -0.001, 1e-6, 3.141592653589793, -2.718281828459045,
+	12345.678, 0.9999999, -1.0000001, 360.0 / 131072 / 3, 1e-9
+};
+
+#define COUNT(list) ((int)(sizeof(list) / sizeof(list[0])))
+
+static int case_count = 0;
+static int skip_count = 0;
+static int near_count = 0;
+static int fail_count = 0;
+
+static void check(int value, double factor, int exact);
+static int check_reject(void);
+
+int main(int argc, char* argv[])
+{
+	int i, j, opt;
+	int random_count = 100000;
+	unsigned int seed = 1;
+	int value;
+
+	while((opt = getopt(argc, argv, "n:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'n' : random_count = atoi(optarg); break;
+			default :
+				fprintf(stderr, "usage : %s [-n random values]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	for(j = 0; j < COUNT(exact_factor_list); j++)
+	{
+		for(i = 0; i < COUNT(value_list); i++)
+			check(value_list[i], exact_factor_list[j], 1);
+	}
+
+	for(j = 0; j < COUNT(inexact_factor_list); j++)
+	{
+		for(i = 0; i < COUNT(value_list); i++)
+			check(value_list[i], inexact_factor_list[j], 0);
+	}
+
+	/* linear congruential values, over the full int range */
+	for(i = 0; i < random_count; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		value = (int)seed;
+		check(value, exact_factor_list[i % COUNT(exact_factor_list)], 1);
+		check(value >> (i % 24), inexact_factor_list[i % COUNT(inexact_factor_list)], 0);
+	}
+
+	fail_count += check_reject();
+
+	printf("{\"cases\":%d,\"skipped\":%d,\"near_integer\":%d,\"failures\":%d}\n",
+		case_count, skip_count, near_count, fail_count);
+
+	return fail_count != 0;
+}
+
+static void check(int value, double factor, int exact)
+{
+	long long factor_q;
+	double product = (double)value * factor;
+	double distance;
+	int expected, result;
+
+	if(product >= 2147483648.0 || product <= -2147483649.0)
+	{
+		skip_count++;
+		return;
+	}
+
+	case_count++;
+	if(cia402_factor_to_q(factor, &factor_q) != 0)
+	{
+		printf("factor %.17g rejected\n", factor);
+		fail_count++;
+		return;
+	}
+
+	expected = (int)product;
+	result = cia402_scale_q(value, factor_q);
+	if(result == expected)
+		return;
+
+	/* the documented bound, plus the rounding of the double product */
+	distance = fabs(product - nearbyint(product));
+	if(!exact && abs(result - expected) == 1 &&
+		distance <= fabs((double)value) * ldexp(1.0, -33) + fabs(product) * ldexp(1.0, -52))
+	{
+		near_count++;
+		return;
+	}
+
+	printf("value %d factor %.17g : fixed %d, double %d\n", value, factor, result, expected);
+	fail_count++;
+}
+
+static int check_reject(void)
+{
+	int i;
+	int fail = 0;
+	long long factor_q = 42;
+	const double factor_list[] = {NAN, INFINITY, -INFINITY};
+
+	for(i = 0; i < COUNT(factor_list); i++)
+	{
+		if(cia402_factor_to_q(factor_list[i], &factor_q) == 0 || factor_q != 42)
+		{
+			printf("factor %g accepted\n", factor_list[i]);
+			fail++;
+		}
+	}
+
+	return fail;
+}
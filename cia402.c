@@ -1,5 +1,6 @@
 #include "cia402.h"
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,11 +10,38 @@
 #include "io.h"
 
 #define CW_INDEX 0x6040
+#define SW_INDEX 0x6041
+#define MO_INDEX 0x6060
+
+/* SYNC0 activation, written to register 0x0980 */
+#define DC_ASSIGN_ACTIVATE 0x0300
 
 #define PW_CTL_NAME "power"
 #define PW_FDB_NAME "feedback"
-#define POS_TGT_NAME "target"
-#define POS_FCT_NAME "factor"
+#define MODE_NAME "mode"
+
+/* mode of operation of unmapped nodes */
+#define DEFAULT_MODE 0x8
+
+/* logical names of the scaled quantities, see cia402.h */
+static const struct
+{
+	const char* name;
+	const char* factor_name;
+	int role;
+	int index;
+	int direction;
+	int bit_length;
+} channel_info_list[CIA402_CHANNEL_COUNT] =
+{
+	{"target", "factor", IO_ROLE_TARGET, 0x607a, 0, 32},
+	{"velocity", "velocity_factor", IO_ROLE_VELOCITY, 0x60ff, 0, 32},
+	{"torque", "torque_factor", IO_ROLE_TORQUE, 0x6071, 0, 16},
+	{"position", "position_factor", IO_ROLE_POSITION, 0x6064, 1, 32},
+	{"actual_velocity", "actual_velocity_factor", IO_ROLE_ACTUAL_VELOCITY, 0x606c, 1, 32},
+	{"actual_torque", "actual_torque_factor", IO_ROLE_ACTUAL_TORQUE, 0x6077, 1, 16},
+	{"following_error", "following_error_factor", IO_ROLE_FOLLOWING_ERROR, 0x60f4, 1, 32}
+};
 
 /* From CiA402, page 27
 
@@ -66,17 +94,42 @@ xxxx xxxx x0xx 1000 | Fault
 #define Halt            0x0100
 /* CiA402 statemachine definition end */
 
+/* control word rules indexed by (power << 7) | FSAFromStatusWord(sw)
+
+	The switch of plc_cia402node.c is compiled into an and-mask and an
+	or-mask per state, so publish runs without branches per node.
+*/
+#define RULE_COUNT 256
+
+static uint16_t cw_and_list[RULE_COUNT];
+static uint16_t cw_or_list[RULE_COUNT];
+
+/* bindings of unmapped names */
+static int dummy_power = 0;
+static int dummy_feedback = 0;
+static int dummy_mode = DEFAULT_MODE;
+static int dummy_value = 0;
+static double dummy_factor = 1.0;
+
+static void build_rule_list(void);
+static void load_factor_list(cia402_channel_t* channel, int count);
+static void scale_list(const cia402_channel_t* channel, const int* src, int* dst, int count);
+static void set_rule(int fsa, int power, int clear, int set);
+static void carve_table(cia402_table_t* table, int node_count, int slave_count);
 static int is_cia402_node(igh_slave_t* slave);
-static int get_index_from_position(cia402_node_t* cia402_node_list, int cia402_node_count, int position);
+static int get_role(const io_mapping_info_t* mapping, int* position);
+static int get_channel_from_role(int role);
+static void set_object(io_mapping_info_t* info, int position, int index, int direction);
+static int get_index_from_position(cia402_table_t* table, int position);
 
-int cia402_get_node_list(igh_slave_t* slave_list, int slave_count,
-	cia402_node_t** cia402_node_list, int* cia402_node_count)
+int cia402_get_node_table(igh_slave_t* slave_list, int slave_count, cia402_table_t* table)
 {
-	int i, j;
+	int i, j, c;
 	int node_count = 0;
+	cia402_channel_t* channel;
 
-	*cia402_node_count = 0;
-	*cia402_node_list = NULL;
+	memset(table, 0, sizeof(cia402_table_t));
+	build_rule_list();
 
 	/* count CiA402 nodes */
 	for(i = 0; i < slave_count; i++)
@@ -85,133 +138,148 @@ int cia402_get_node_list(igh_slave_t* slave_list, int slave_count,
 			node_count++;
 	}
 
-	*cia402_node_count = node_count;
-	*cia402_node_list = (cia402_node_t*)malloc(sizeof(cia402_node_t) * node_count);
-	memset(*cia402_node_list, 0, sizeof(cia402_node_t) * node_count);
+	/* one block for all arrays, sized by a first carving pass */
+	arena_init(&(table -> arena));
+	carve_table(table, node_count, slave_count);
+	if(arena_commit(&(table -> arena)) != 0)
+		return 1;
+	carve_table(table, node_count, slave_count);
 
 	/* initialize CiA402 nodes */
 	j = 0;
 	for(i = 0; i < slave_count; i++)
 	{
+		table -> node_index[i] = -1;
 		if(is_cia402_node(&slave_list[i]))
 		{
-			(*cia402_node_list)[j].position = i;
-			(*cia402_node_list)[j].mode_of_operation = 0x8;
-			sprintf((*cia402_node_list)[j].cw_address, "%d:0x6040:0x0", i);
-			sprintf((*cia402_node_list)[j].sw_address, "%d:0x6041:0x0", i);
-			sprintf((*cia402_node_list)[j].mo_address, "%d:0x6060:0x0", i);
-			sprintf((*cia402_node_list)[j].tp_address, "%d:0x607a:0x0", i);
+			table -> node_index[i] = j;
+			table -> node_list[j].position = i;
+			slave_list[i].dc_assign_activate = DC_ASSIGN_ACTIVATE;
+
+			table -> mode_of_operation[j] = DEFAULT_MODE;
+			table -> power_control[j] = &dummy_power;
+			table -> power_feedback[j] = &dummy_feedback;
+			table -> mode_control[j] = &dummy_mode;
+
+			for(c = 0; c < CIA402_CHANNEL_COUNT; c++)
+			{
+				channel = &(table -> channel_list[c]);
+				channel -> model[j] = &dummy_value;
+				channel -> factor[j] = &dummy_factor;
+			}
+
+			/* requests can only be created before activation */
+			if(sdo_channel_init(&(table -> sdo_channel_list[j]), slave_list[i].config_p) != 0)
+			{
+				printf("EtherCAT creating SDO requests of slave %d failed!\n", i);
+				return 1;
+			}
 			j++;
 		}
 	}
+	table -> count = node_count;
+	table -> slave_count = slave_count;
+
+	if(node_count != 0 && sdo_init(table -> sdo_channel_list, node_count) != 0)
+		return 1;
 
 	return 0;
 }
 
-int cia402_free_node_list(cia402_node_t** cia402_node_list)
+int cia402_free_node_table(cia402_table_t* table)
 {
-	if(*cia402_node_list != NULL)
-	{
-		free(*cia402_node_list);
-		*cia402_node_list = NULL;
-	}
+	sdo_free();
+	arena_free(&(table -> arena));
+	memset(table, 0, sizeof(cia402_table_t));
 
 	return 0;
 }
 
-int cia402_get_mapping_list(cia402_node_t* cia402_node_list, int cia402_node_count,
+int cia402_get_mapping_list(cia402_table_t* table,
 	io_mapping_info_t* mapping_list, int mapping_count,
 	io_mapping_info_t** cia402_mapping_list, int* cia402_mapping_count)
 {
 	int i, j, k, index;
 	int position;
-	char buffer[1023];
+	int c, role;
+	cia402_channel_t* channel;
+	io_mapping_info_t* info;
 
-	*cia402_mapping_count = cia402_node_count + mapping_count;
-	*cia402_mapping_list = (io_mapping_info_t*)malloc(sizeof(io_mapping_info_t) * (cia402_node_count + mapping_count));
+	*cia402_mapping_count = table -> count + mapping_count;
+	*cia402_mapping_list = (io_mapping_info_t*)malloc(sizeof(io_mapping_info_t) * (table -> count + mapping_count));
 
 	for(i = 0, k = 0; i < mapping_count; i++, k++)
 	{
-		sscanf(mapping_list[i].network_addr, "%d:%s", &position, buffer);
+		role = get_role(&(mapping_list[i]), &position);
+		info = &((*cia402_mapping_list)[k]);
 
-		/* power control mapping info is changed to control word */
-		if(!strcmp(buffer, PW_CTL_NAME))
+		/* other mapping info is copied as it is */
+		if(role == IO_ROLE_OBJECT)
 		{
-			index = get_index_from_position(cia402_node_list, cia402_node_count, position);
-			if(index == -1)
-			{
-				printf("EtherCAT %d slave is not CiA402 node!\n", position);
-				cia402_free_mapping_list(cia402_mapping_list);
-				return 1;
-			}
+			memcpy(info, &(mapping_list[i]), sizeof(io_mapping_info_t));
+			continue;
+		}
 
-			cia402_node_list[index].power_control = (int*)mapping_list[i].model_addr;
-			(*cia402_mapping_list)[k].model_addr = &(cia402_node_list[index].control_word);
-			(*cia402_mapping_list)[k].size = sizeof(int);
-			(*cia402_mapping_list)[k].network_addr = cia402_node_list[index].cw_address;
-			(*cia402_mapping_list)[k].direction = 0;
+		index = get_index_from_position(table, position);
+		if(index == -1)
+		{
+			printf("EtherCAT %d slave is not CiA402 node!\n", position);
+			cia402_free_mapping_list(cia402_mapping_list);
+			return 1;
 		}
-		/* power feedback mapping info is changed to status word */
-		else if(!strcmp(buffer, PW_FDB_NAME))
+
+		c = get_channel_from_role(role & ~IO_ROLE_FACTOR);
+		if(c == -1 && role != IO_ROLE_POWER && role != IO_ROLE_FEEDBACK && role != IO_ROLE_MODE)
 		{
-			index = get_index_from_position(cia402_node_list, cia402_node_count, position);
-			if(index == -1)
-			{
-				printf("EtherCAT %d slave is not CiA402 node!\n", position);
-				cia402_free_mapping_list(cia402_mapping_list);
-				return 1;
-			}
+			printf("EtherCAT role %d of slave %d is unknown!\n", role, position);
+			cia402_free_mapping_list(cia402_mapping_list);
+			return 1;
+		}
 
-			cia402_node_list[index].power_feedback = (int*)mapping_list[i].model_addr;
-			(*cia402_mapping_list)[k].model_addr = &(cia402_node_list[index].status_word);
-			(*cia402_mapping_list)[k].size = sizeof(int);
-			(*cia402_mapping_list)[k].network_addr = cia402_node_list[index].sw_address;
-			(*cia402_mapping_list)[k].direction = 1;
+		/* power control mapping info is changed to control word */
+		if(role == IO_ROLE_POWER)
+		{
+			table -> power_control[index] = (int*)mapping_list[i].model_addr;
+			set_object(info, position, CW_INDEX, 0);
+			info -> model_addr = &(table -> control_word[index]);
 		}
-		/* scaled target position info is changed to raw target position */
-		else if(!strcmp(buffer, POS_TGT_NAME))
+		/* power feedback mapping info is changed to status word */
+		else if(role == IO_ROLE_FEEDBACK)
 		{
-			index = get_index_from_position(cia402_node_list, cia402_node_count, position);
-			if(index == -1)
-			{
-				printf("EtherCAT %d slave is not CiA402 node!\n", position);
-				cia402_free_mapping_list(cia402_mapping_list);
-				return 1;
-			}
-
-			cia402_node_list[index].scaled_target = (int*)mapping_list[i].model_addr;
-			(*cia402_mapping_list)[k].model_addr = &(cia402_node_list[index].target_position);
-			(*cia402_mapping_list)[k].size = sizeof(int);
-			(*cia402_mapping_list)[k].network_addr = cia402_node_list[index].tp_address;
-			(*cia402_mapping_list)[k].direction = 0;
+			table -> power_feedback[index] = (int*)mapping_list[i].model_addr;
+			set_object(info, position, SW_INDEX, 1);
+			info -> model_addr = &(table -> status_word[index]);
 		}
-		/* target position scale factor info is stored to CiA402 structure */
-		else if(!strcmp(buffer, POS_FCT_NAME))
+		/* mode of operation is always mapped, only the model is bound */
+		else if(role == IO_ROLE_MODE)
 		{
-			index = get_index_from_position(cia402_node_list, cia402_node_count, position);
-			if(index == -1)
-			{
-				printf("EtherCAT %d slave is not CiA402 node!\n", position);
-				cia402_free_mapping_list(cia402_mapping_list);
-				return 1;
-			}
-
-			cia402_node_list[index].scale_factor = (double*)mapping_list[i].model_addr;
+			table -> mode_control[index] = (int*)mapping_list[i].model_addr;
 			(*cia402_mapping_count)--;
 			k--;
 		}
-		/* other mapping info is copied as it is */
+		/* scale factors are stored to CiA402 table */
+		else if(role & IO_ROLE_FACTOR)
+		{
+			table -> channel_list[c].factor[index] = (double*)mapping_list[i].model_addr;
+			(*cia402_mapping_count)--;
+			k--;
+		}
+		/* scaled values are changed to raw values */
 		else
-			memcpy(&((*cia402_mapping_list)[k]), &(mapping_list[i]), sizeof(io_mapping_info_t));
+		{
+			channel = &(table -> channel_list[c]);
+			channel -> model[index] = (int*)mapping_list[i].model_addr;
+			channel -> mapped = 1;
+			set_object(info, position, channel_info_list[c].index, channel_info_list[c].direction);
+			info -> model_addr = &(channel -> raw[index]);
+		}
 	}
 
 	/* setting up mapping infomation to mode of operation */
-	for(j = 0; j < cia402_node_count; j++, k++)
+	for(j = 0; j < table -> count; j++, k++)
 	{
-		(*cia402_mapping_list)[k].model_addr = &(cia402_node_list[j].mode_of_operation);
-		(*cia402_mapping_list)[k].size = sizeof(int);
-		(*cia402_mapping_list)[k].network_addr = cia402_node_list[j].mo_address;
-		(*cia402_mapping_list)[k].direction = 0;
+		set_object(&((*cia402_mapping_list)[k]), table -> node_list[j].position, MO_INDEX, 0);
+		(*cia402_mapping_list)[k].model_addr = &(table -> mode_of_operation[j]);
 	}
 
 	return 0;
@@ -228,86 +296,220 @@ int cia402_free_mapping_list(io_mapping_info_t** cia402_mapping_list)
 	return 0;
 }
 
-int cia402_publish(cia402_node_t* cia402_node_list, int cia402_node_count)
+/* true for the control word, status word, mode and raw values of the nodes */
+int cia402_is_table_variable(const cia402_table_t* table, const void* variable)
 {
-	int i;
-	int power, cw;
+	const char* base = table -> arena.base;
+
+	return base != NULL && (const char*)variable >= base && (const char*)variable < base + table -> arena.size;
+}
 
-	for(i = 0; i < cia402_node_count; i++)
+int cia402_sdo_submit(cia402_table_t* table, io_sdo_t* sdo)
+{
+	if(sdo -> slave < 0 || sdo -> slave >= table -> slave_count || table -> node_index[sdo -> slave] < 0)
+		return 1;
+
+	return sdo_submit(table -> node_index[sdo -> slave], sdo);
+}
+
+int cia402_publish(cia402_table_t* table)
+{
+	int i, c, rule;
+	int count = table -> count;
+	int* control_word = table -> control_word;
+	const int* status_word = table -> status_word;
+	int* mode_of_operation = table -> mode_of_operation;
+	cia402_channel_t* channel;
+
+	/* step the statemachine */
+	for(i = 0; i < count; i++)
 	{
-		// power command
-		if(cia402_node_list[i].power_control == NULL)
-			power = 0;
-		else
-		{
-			power = (cia402_node_list[i].status_word & SW_VoltageEnabled)
-				&& *(cia402_node_list[i].power_control);
-		}
-		cw = cia402_node_list[i].control_word;
+		rule = (((status_word[i] & SW_VoltageEnabled) != 0) & (*(table -> power_control[i]) != 0)) << 7 |
+			FSAFromStatusWord(status_word[i]);
+		control_word[i] = (control_word[i] & cw_and_list[rule]) | cw_or_list[rule];
+		mode_of_operation[i] = *(table -> mode_control[i]);
+	}
 
-		// CiA402 statemachine (copied from plc_cia402node.c in beremiz (180119))
-		switch(FSAFromStatusWord(cia402_node_list[i].status_word))
-		{
-			case SwitchOnDisabled :
-			case SwitchOnDisabled2 :
-				cw &= ~(SwitchOn | FaultReset);
-				cw |= EnableVoltage | QuickStop;
-				break;
-			case ReadyToSwitchOn :
-			case OperationEnabled :
-				if(!power)
-				{
-					cw &= ~(FaultReset | EnableOperation);
-					cw |= SwitchOn | EnableVoltage | QuickStop;
-					break;
-				}
-			case SwitchedOn :
-				if(power)
-				{
-					cw &= ~(FaultReset);
-					cw |= SwitchOn | EnableVoltage | QuickStop | EnableOperation;
-				}
-				break;
-			case Fault :
-			case Fault2 :
-				cw &= ~(SwitchOn | EnableVoltage | QuickStop | EnableOperation);
-				cw |= FaultReset;
-				break;
-			default:
-				break;
-		}
-		cia402_node_list[i].control_word = cw;
+	/* gather and scale mapped outputs */
+	for(c = 0; c < CIA402_CHANNEL_COUNT; c++)
+	{
+		channel = &(table -> channel_list[c]);
+		if(!channel -> mapped || channel_info_list[c].direction != 0)
+			continue;
 
-		// cacluate raw target position
-		if(cia402_node_list[i].scaled_target != NULL)
-		{
-			if(cia402_node_list[i].scale_factor == NULL)
-				cia402_node_list[i].target_position = *(cia402_node_list[i].scaled_target);
-			else
-				cia402_node_list[i].target_position =
-					(int)((double)*(cia402_node_list[i].scaled_target) * *(cia402_node_list[i].scale_factor));
-		}
+		for(i = 0; i < count; i++)
+			channel -> value[i] = *(channel -> model[i]);
+		load_factor_list(channel, count);
+		scale_list(channel, channel -> value, channel -> raw, count);
 	}
 
 	return 0;
 }
 
-int cia402_retrieve(cia402_node_t* cia402_node_list, int cia402_node_count)
+int cia402_retrieve(cia402_table_t* table)
 {
-	int i;
+	int i, c, shift;
+	int count = table -> count;
+	cia402_channel_t* channel;
 
-	for(i = 0; i < cia402_node_count; i++)
+	for(i = 0; i < count; i++)
+		*(table -> power_feedback[i]) = FSAFromStatusWord(table -> status_word[i]) == OperationEnabled;
+
+	/* scale and scatter mapped inputs, sign extended from the entry width */
+	for(c = 0; c < CIA402_CHANNEL_COUNT; c++)
 	{
-		if(cia402_node_list[i].power_feedback == NULL)
+		channel = &(table -> channel_list[c]);
+		if(!channel -> mapped || channel_info_list[c].direction != 1)
 			continue;
 
-		int fsa = FSAFromStatusWord(cia402_node_list[i].status_word);
-		*(cia402_node_list[i].power_feedback) = fsa == OperationEnabled;
+		shift = 32 - channel_info_list[c].bit_length;
+		for(i = 0; i < count; i++)
+			channel -> value[i] = (int)((unsigned int)channel -> raw[i] << shift) >> shift;
+		load_factor_list(channel, count);
+		scale_list(channel, channel -> value, channel -> value, count);
+		for(i = 0; i < count; i++)
+			*(channel -> model[i]) = channel -> value[i];
+	}
+
+	return 0;
+}
+
+static void build_rule_list(void)
+{
+	int i;
+
+	for(i = 0; i < RULE_COUNT; i++)
+	{
+		cw_and_list[i] = 0xffff;
+		cw_or_list[i] = 0;
 	}
 
+	// CiA402 statemachine (copied from plc_cia402node.c in beremiz (180119))
+	set_rule(SwitchOnDisabled, -1, SwitchOn | FaultReset, EnableVoltage | QuickStop);
+	set_rule(SwitchOnDisabled2, -1, SwitchOn | FaultReset, EnableVoltage | QuickStop);
+	set_rule(ReadyToSwitchOn, 0, FaultReset | EnableOperation, SwitchOn | EnableVoltage | QuickStop);
+	set_rule(OperationEnabled, 0, FaultReset | EnableOperation, SwitchOn | EnableVoltage | QuickStop);
+	set_rule(ReadyToSwitchOn, 1, FaultReset, SwitchOn | EnableVoltage | QuickStop | EnableOperation);
+	set_rule(OperationEnabled, 1, FaultReset, SwitchOn | EnableVoltage | QuickStop | EnableOperation);
+	set_rule(SwitchedOn, 1, FaultReset, SwitchOn | EnableVoltage | QuickStop | EnableOperation);
+	set_rule(Fault, -1, SwitchOn | EnableVoltage | QuickStop | EnableOperation, FaultReset);
+	set_rule(Fault2, -1, SwitchOn | EnableVoltage | QuickStop | EnableOperation, FaultReset);
+}
+
+static void load_factor_list(cia402_channel_t* channel, int count)
+{
+	int i;
+#ifdef CIA402_FIXED_SCALE
+	double factor;
+
+	/* factors rarely change, convert them only then, NaN or infinity keeps the last one */
+	for(i = 0; i < count; i++)
+	{
+		factor = *(channel -> factor[i]);
+		if(factor != channel -> factor_value[i])
+		{
+			channel -> factor_value[i] = factor;
+			cia402_factor_to_q(factor, &(channel -> factor_q[i]));
+		}
+	}
+#else
+	for(i = 0; i < count; i++)
+		channel -> factor_value[i] = *(channel -> factor[i]);
+#endif
+}
+
+static void scale_list(const cia402_channel_t* channel, const int* src, int* dst, int count)
+{
+	int i;
+
+	for(i = 0; i < count; i++)
+	{
+#ifdef CIA402_FIXED_SCALE
+		dst[i] = cia402_scale_q(src[i], channel -> factor_q[i]);
+#else
+		dst[i] = (int)((double)src[i] * channel -> factor_value[i]);
+#endif
+	}
+}
+
+/* factor rounded to nearest Q32.32, saturated beyond the int range */
+int cia402_factor_to_q(double factor, long long* factor_q)
+{
+	if(!isfinite(factor))
+		return 1;
+
+	if(factor >= 2147483648.0)
+		*factor_q = 0x7fffffffffffffffLL;
+	else if(factor <= -2147483648.0)
+		*factor_q = -0x7fffffffffffffffLL - 1;
+	else
+		*factor_q = (long long)(factor * 4294967296.0 + (factor < 0 ? -0.5 : 0.5));
+
 	return 0;
 }
 
+/* value * factor_q / 2^32 truncated toward zero, in 64 bit arithmetic
+
+	factor_q is split into its upper (signed) and lower (unsigned) 32 bits,
+	both partial products fit in 64 bit. The floor of the lower product is
+	corrected to truncation when the result is negative and not exact.
+*/
+int cia402_scale_q(int value, long long factor_q)
+{
+	long long high = (long long)value * (factor_q >> 32);
+	long long low = (long long)value * (long long)(factor_q & 0xffffffffLL);
+	long long result = high + (low >> 32);
+
+	return (int)(result + ((result < 0) & ((low & 0xffffffffLL) != 0)));
+}
+
+/* power -1 sets the rule for both power states */
+static void set_rule(int fsa, int power, int clear, int set)
+{
+	if(power != 1)
+	{
+		cw_and_list[fsa] = ~clear;
+		cw_or_list[fsa] = set;
+	}
+	if(power != 0)
+	{
+		cw_and_list[(1 << 7) | fsa] = ~clear;
+		cw_or_list[(1 << 7) | fsa] = set;
+	}
+}
+
+/* widest members first, every array is ARENA_ALIGN aligned anyway */
+static void carve_table(cia402_table_t* table, int node_count, int slave_count)
+{
+	int c;
+	arena_t* arena = &(table -> arena);
+
+	for(c = 0; c < CIA402_CHANNEL_COUNT; c++)
+	{
+		table -> channel_list[c].factor_q = (long long*)arena_alloc(arena, sizeof(long long) * node_count);
+		table -> channel_list[c].factor_value = (double*)arena_alloc(arena, sizeof(double) * node_count);
+	}
+	for(c = 0; c < CIA402_CHANNEL_COUNT; c++)
+	{
+		table -> channel_list[c].model = (int**)arena_alloc(arena, sizeof(int*) * node_count);
+		table -> channel_list[c].factor = (double**)arena_alloc(arena, sizeof(double*) * node_count);
+	}
+	table -> power_control = (int**)arena_alloc(arena, sizeof(int*) * node_count);
+	table -> power_feedback = (int**)arena_alloc(arena, sizeof(int*) * node_count);
+	table -> mode_control = (int**)arena_alloc(arena, sizeof(int*) * node_count);
+	for(c = 0; c < CIA402_CHANNEL_COUNT; c++)
+	{
+		table -> channel_list[c].raw = (int*)arena_alloc(arena, sizeof(int) * node_count);
+		table -> channel_list[c].value = (int*)arena_alloc(arena, sizeof(int) * node_count);
+	}
+	table -> control_word = (int*)arena_alloc(arena, sizeof(int) * node_count);
+	table -> status_word = (int*)arena_alloc(arena, sizeof(int) * node_count);
+	table -> mode_of_operation = (int*)arena_alloc(arena, sizeof(int) * node_count);
+	table -> node_index = (int*)arena_alloc(arena, sizeof(int) * slave_count);
+	table -> node_list = (cia402_node_t*)arena_alloc(arena, sizeof(cia402_node_t) * node_count);
+	table -> sdo_channel_list = (sdo_channel_t*)arena_alloc(arena, sizeof(sdo_channel_t) * node_count);
+}
+
 static int is_cia402_node(igh_slave_t* slave)
 {
 	int i, j;
@@ -332,15 +534,71 @@ static int is_cia402_node(igh_slave_t* slave)
 	return 0;
 }
 
-static int get_index_from_position(cia402_node_t* cia402_node_list, int cia402_node_count, int position)
+/* role of a mapping, logical names of the string form are looked up */
+static int get_role(const io_mapping_info_t* mapping, int* position)
+{
+	int i;
+	char buffer[1023];
+
+	if(mapping -> network_addr == NULL)
+	{
+		*position = mapping -> addr.slave;
+		return mapping -> addr.role;
+	}
+
+	if(sscanf(mapping -> network_addr, "%d:%1022s", position, buffer) != 2)
+		return IO_ROLE_OBJECT;
+
+	if(!strcmp(buffer, PW_CTL_NAME))
+		return IO_ROLE_POWER;
+	if(!strcmp(buffer, PW_FDB_NAME))
+		return IO_ROLE_FEEDBACK;
+	if(!strcmp(buffer, MODE_NAME))
+		return IO_ROLE_MODE;
+
+	for(i = 0; i < CIA402_CHANNEL_COUNT; i++)
+	{
+		if(!strcmp(buffer, channel_info_list[i].name))
+			return channel_info_list[i].role;
+		if(!strcmp(buffer, channel_info_list[i].factor_name))
+			return channel_info_list[i].role | IO_ROLE_FACTOR;
+	}
+
+	return IO_ROLE_OBJECT;
+}
+
+static int get_channel_from_role(int role)
 {
 	int i;
 
-	for(i = 0; i < cia402_node_count; i++)
+	for(i = 0; i < CIA402_CHANNEL_COUNT; i++)
 	{
-		if(cia402_node_list[i].position == position)
+		if(channel_info_list[i].role == role)
 			return i;
 	}
 
 	return -1;
 }
+
+/* typed entry of a node object, passed to igh.c without formatting */
+static void set_object(io_mapping_info_t* info, int position, int index, int direction)
+{
+	memset(info, 0, sizeof(io_mapping_info_t));
+	info -> size = sizeof(int);
+	info -> network_addr = NULL;
+	info -> direction = direction;
+	info -> mode = IO_MAPPING_COPY;
+	info -> rate_group = 0;
+	info -> addr.slave = position;
+	info -> addr.index = index;
+	info -> addr.subindex = 0;
+	info -> addr.role = IO_ROLE_OBJECT;
+}
+
+static int get_index_from_position(cia402_table_t* table, int position)
+{
+	if(position < 0 || position >= table -> slave_count)
+		return -1;
+
+	return table -> node_index[position];
+}
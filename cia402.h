@@ -1,39 +1,113 @@
 #ifndef _CIA402_H
 #define _CIA402_H
 
+#include "arena.h"
 #include "igh.h"
 #include "io.h"
+#include "sdo.h"
 
+/* scaled quantities
+
+	Logical names accepted by cia402_get_mapping_list() as "position:name",
+	each with its factor name ("position:name_factor", a double) :
+		target (factor)                  0x607a, output, CSP
+		velocity (velocity_factor)       0x60ff, output, CSV
+		torque (torque_factor)           0x6071, output, CST
+		position (position_factor)       0x6064, input
+		actual_velocity (...)            0x606c, input
+		actual_torque (...)              0x6077, input
+		following_error (...)            0x60f4, input
+	Outputs are sent as model * factor, inputs are returned as raw * factor.
+	Besides, "power" and "feedback" control the drive state and "mode" is
+	the mode of operation (int, 8 CSP by default, 9 CSV, 10 CST).
+*/
+#define CIA402_TARGET 0
+#define CIA402_VELOCITY 1
+#define CIA402_TORQUE 2
+#define CIA402_POSITION 3
+#define CIA402_ACTUAL_VELOCITY 4
+#define CIA402_ACTUAL_TORQUE 5
+#define CIA402_FOLLOWING_ERROR 6
+#define CIA402_CHANNEL_COUNT 7
+
+/* setup data of a node, not touched by publish/retrieve */
 typedef struct
 {
 	int position;
+} cia402_node_t;
 
-	int* power_control;
-	int* power_feedback;
-	int* scaled_target;
-	double* scale_factor;
+/* one scaled quantity of all nodes, skipped unless mapped on any node */
+typedef struct
+{
+	int mapped;
 
-	int control_word;
-	int status_word;
-	int mode_of_operation;
-	int target_position;
+	int* raw;
+	int* value;
+	double* factor_value;
+	long long* factor_q;
 
-	char cw_address[15];
-	char sw_address[15];
-	char mo_address[15];
-	char tp_address[15];
-} cia402_node_t;
+	int** model;
+	double** factor;
+} cia402_channel_t;
+
+/* CiA402 node table
+
+	The per-cycle data of all nodes is kept as one array per field, so that
+	cia402_publish() and cia402_retrieve() run straight loops over
+	contiguous memory. The model bindings are never NULL : unmapped names
+	are bound to dummies (power off, mode CSP, target 0, factor 1, inputs
+	discarded).
+
+	With CIA402_FIXED_SCALE, values are scaled by factor_q, the factor
+	rounded to Q32.32, which is recomputed only when the model factor
+	changes. The result is truncated toward zero like the double path and
+	is identical to it when the factor is a multiple of 2^-32 (integers,
+	binary fractions like 2.5 or 0.125). Otherwise the factor error is at
+	most 2^-33, so the result differs by at most one count and only where
+	value * factor lies within |value| * 2^-33 of an integer. A NaN or
+	infinite factor is ignored and the last valid one kept. bench/scale_check
+	compares both paths over boundary values.
+*/
+typedef struct
+{
+	int count;
+	cia402_node_t* node_list;
+
+	/* node index of every slave position, -1 for other slaves */
+	int slave_count;
+	int* node_index;
+
+	int* control_word;
+	int* status_word;
+	int* mode_of_operation;
+
+	int** power_control;
+	int** power_feedback;
+	int** mode_control;
 
-int cia402_get_node_list(igh_slave_t* slave_list, int slave_count,
-	cia402_node_t** cia402_node_list, int* cia402_node_count);
-int cia402_free_node_list(cia402_node_t** cia402_node_list);
+	cia402_channel_t channel_list[CIA402_CHANNEL_COUNT];
 
-int cia402_get_mapping_list(cia402_node_t* cia402_node_list, int cia402_node_count,
+	/* SDO requests of every node, see sdo.h */
+	sdo_channel_t* sdo_channel_list;
+
+	arena_t arena;
+} cia402_table_t;
+
+int cia402_get_node_table(igh_slave_t* slave_list, int slave_count, cia402_table_t* table);
+int cia402_free_node_table(cia402_table_t* table);
+
+int cia402_get_mapping_list(cia402_table_t* table,
 	io_mapping_info_t* mapping_list, int mapping_count,
 	io_mapping_info_t** cia402_mapping_list, int* cia402_mapping_count);
 int cia402_free_mapping_list(io_mapping_info_t** cia402_mapping_list);
+int cia402_is_table_variable(const cia402_table_t* table, const void* variable);
+int cia402_sdo_submit(cia402_table_t* table, io_sdo_t* sdo);
+
+int cia402_publish(cia402_table_t* table);
+int cia402_retrieve(cia402_table_t* table);
 
-int cia402_publish(cia402_node_t* cia402_node_list, int cia402_node_count);
-int cia402_retrieve(cia402_node_t* cia402_node_list, int cia402_node_count);
+/* fixed-point scaling of CIA402_FIXED_SCALE, a NaN or infinite factor is rejected */
+int cia402_factor_to_q(double factor, long long* factor_q);
+int cia402_scale_q(int value, long long factor_q);
 
 #endif
@@ -3,9 +3,42 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#ifdef __XENO__
+#include <native/timer.h>
+#endif
+
+#include "arena.h"
 #include "ecrt.h"
+#include "image.h"
 #include "io.h"
+#include "prof.h"
+#include "recorder.h"
+
+/* PDO entry index built by igh_init()
+
+	Open addressing with linear probing, keyed by slave, index, subindex
+	and direction, so igh_mapping() looks up an entry in constant time
+	instead of scanning the slave's PDOs. The table is kept at most half
+	full; key 0 marks an empty slot, valid keys have IGH_ENTRY_KEY_VALID set.
+	Once registered, the slot also records the domain and the location of
+	the entry, which igh_remap() binds new variables to.
+*/
+#define IGH_ENTRY_KEY_VALID (1ULL << 63)
+
+typedef struct
+{
+	unsigned long long key;
+	unsigned int bit_length;
+
+	int domain;
+	unsigned int offset;
+	unsigned int bit_pos;
+} igh_entry_slot_t;
 
 typedef struct
 {
@@ -15,14 +48,181 @@ typedef struct
 	unsigned int offset;
 	unsigned int bit_pos;
 	unsigned int bit_length;
+
+	int domain;
+
+	/* index slot of the entry, records where it was registered */
+	igh_entry_slot_t* entry;
 } igh_value_t;
 
+/* copy program compiled from an input/output list by igh_mapping()
+
+	Entries are sorted by domain offset. Adjacent byte-aligned entries whose
+	model variables are also adjacent are merged into block copies, the rest
+	of the byte-aligned entries are split into per-width lists and bit
+	entries are grouped per domain byte, so that igh_exchange() runs a few
+	straight-line loops instead of a switch per entry.
+*/
+typedef struct
+{
+	uint8_t* variable;
+	unsigned int offset;
+	unsigned int length;
+} igh_block_op_t;
+
+typedef struct
+{
+	void* variable;
+	unsigned int offset;
+} igh_word_op_t;
+
+typedef struct
+{
+	uint8_t* variable;
+	uint8_t mask;
+} igh_bit_op_t;
+
+typedef struct
+{
+	unsigned int offset;
+	int first;
+	int count;
+} igh_bit_group_t;
+
+typedef struct
+{
+	void* memory;
+
+	igh_block_op_t* block_list;
+	igh_word_op_t* u8_list;
+	igh_word_op_t* u16_list;
+	igh_word_op_t* u32_list;
+	igh_bit_op_t* bit_list;
+	igh_bit_group_t* group_list;
+
+	int block_count;
+	int u8_count;
+	int u16_count;
+	int u32_count;
+	int bit_count;
+	int group_count;
+} igh_program_t;
+
+/* one domain per rate group, exchanged every divider-th cycle */
+typedef struct
+{
+	ec_domain_t* domain;
+	uint8_t* pd;
+	unsigned int divider;
+	int entry_count;
+
+	igh_program_t input_program;
+	igh_program_t output_program;
+
+	/* prepared by igh_remap(), swapped in by igh_receive() */
+	igh_program_t next_input_program;
+	igh_program_t next_output_program;
+
+	/* location of the domain in the shared process image */
+	unsigned int image_offset;
+	unsigned int size;
+} igh_domain_t;
+
+#define IGH_MAX_DOMAINS 8
+
+/* igh_remap() gives up after 1 s without a cycle taking the new programs */
+#define IGH_REMAP_WAIT_NS 100000
+#define IGH_REMAP_WAIT_STEPS 10000
+
+/* bus monitoring : one master or slave state query every period cycles */
+#define IGH_MONITOR_PERIOD 1
+#define IGH_STATUS_READ_RETRY 1000
+#define IGH_SLAVE_STATE_UNKNOWN 0xff
+#define IGH_SLAVE_STATE_OP 0x10
+
+/* topology cache file
+
+	The sync managers, PDOs and PDO entries found by igh_init() are stored
+	in flat tables : header, one igh_cache_slave_t per slave, then all PDOs
+	and all entries. The file is mapped on the next igh_init() and a slave
+	whose vendor id, product code and revision at the same position match
+	is taken from it instead of being queried PDO by PDO. The file is
+	rewritten when any slave had to be queried.
+*/
+#define IGH_CACHE_MAGIC 0x54484749
+#define IGH_CACHE_VERSION 1
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	uint32_t slave_count;
+	uint32_t pdo_count;
+	uint32_t entry_count;
+} igh_cache_header_t;
+
+typedef struct
+{
+	uint8_t index;
+	uint8_t dir;
+	uint8_t watchdog_mode;
+	uint8_t reserved;
+	uint32_t n_pdos;
+	uint32_t first_pdo;
+} igh_cache_sync_t;
+
+typedef struct
+{
+	uint32_t vendor_id;
+	uint32_t product_code;
+	uint32_t revision_number;
+	igh_cache_sync_t sync[2];
+} igh_cache_slave_t;
+
+typedef struct
+{
+	uint16_t index;
+	uint16_t reserved;
+	uint32_t n_entries;
+	uint32_t first_entry;
+} igh_cache_pdo_t;
+
+typedef struct
+{
+	uint16_t index;
+	uint8_t subindex;
+	uint8_t bit_length;
+} igh_cache_entry_t;
+
+/* bus scan of igh_init()
+
+	The slave information and the sync manager and PDO headers read by the
+	one walk over the bus. They size the topology arena and are then copied
+	into it, the entries are read straight into the arena. sync[0] holds
+	the outputs, sync[1] the inputs, position the sync manager of each.
+*/
+typedef struct
+{
+	ec_slave_info_t info;
+	ec_sync_info_t sync[2];
+	unsigned int position[2];
+	int cached;
+} igh_scan_t;
+
 static ec_master_t* master = NULL;
-static ec_domain_t* domain1 = NULL;
 static ec_slave_info_t* slave_info_list = NULL;
 static int slave_count = 0;
 
-static uint8_t* domain1_pd = NULL;
+static igh_domain_t domain_list[IGH_MAX_DOMAINS];
+static int domain_count = 0;
+static unsigned long long exchange_cycle = 0;
+static unsigned int in_flight = 0;
+static int master_active = 0;
+static int remap_pending = 0;
+
+static image_t image;
+static unsigned long long exchange_interval = 0;
 
 static ec_pdo_entry_reg_t* pdo_entry_reg = NULL;
 static ec_sync_info_t* input_sync_info_list = NULL;
@@ -33,19 +233,92 @@ static int output_count = 0;
 static igh_value_t* input_list = NULL;
 static igh_value_t* output_list = NULL;
 
-static unsigned int get_pdo_bit_length(uint16_t slave, uint16_t index, uint8_t subindex, int direction); 
-static void free_sync_info_list(ec_sync_info_t* sync_info_list);
+static int direct_count = 0;
+static igh_value_t* direct_list = NULL;
+
+static igh_entry_slot_t* entry_index = NULL;
+static unsigned int entry_index_bits = 0;
+
+static char cache_path[256] = "";
+static igh_cache_header_t* cache = NULL;
+static size_t cache_size = 0;
+
+/* slave information, sync managers, PDOs, entry index and slave list */
+static arena_t topology_arena;
+
+/* distributed clocks */
+static igh_slave_t* dc_slave_list = NULL;
+static int dc_mode = IO_DC_OFF;
+static int dc_shift = 0;
+static int dc_active = 0;
+static int dc_time_set = 0;
+static unsigned long long dc_interval = 0;
+static unsigned long long dc_app_time = 0;
+static unsigned long long dc_last_app_time = 0;
+static io_dc_stat_t dc_stat;
+
+/* slaves and their configurations of igh_init() */
+static igh_slave_t* bus_slave_list = NULL;
+
+/* bus monitoring, the status is written by the cycle only */
+static uint8_t* slave_state_list = NULL;
+static int monitor_period = IGH_MONITOR_PERIOD;
+static int monitor_countdown = 0;
+static int monitor_next = -1;
+static uint32_t status_sequence = 0;
+static io_status_t status;
+
+/* PDO optimization, see igh_pdo_optimize() */
+static uint8_t* pdo_flexible_list = NULL;
+static int pdo_registered = 0;
+static io_pdo_report_t pdo_report;
+
+static igh_entry_slot_t* find_entry(uint16_t slave, uint16_t index, uint8_t subindex, int direction);
 static void clear_inout_list();
+static void build_entry_index(void);
+static int scan_slave(int position, igh_scan_t* scan, int* entry_count);
+static int fill_slave(int position, const igh_scan_t* scan,
+	ec_sync_info_t* input_sync_info, ec_sync_info_t* output_sync_info);
+static void free_scan_list(igh_scan_t* scan_list, int count);
+static void load_cache(void);
+static int load_cached_slave(const ec_slave_info_t* info, int position,
+	ec_sync_info_t* input_sync_info, ec_sync_info_t* output_sync_info, int* entry_count);
+static int save_cache(void);
+static unsigned long long entry_key(uint16_t slave, uint16_t index, uint8_t subindex, int direction);
+static unsigned int entry_hash(unsigned long long key);
+static int get_domain(int rate_group);
+static int compile_program(igh_program_t* program, igh_value_t* value_list, int value_count, int domain);
+static void free_program(igh_program_t* program);
+static void swap_programs(void);
+static void record_registration(const igh_value_t* value_list, int value_count);
+static void free_next_programs(void);
+static int compare_value(const void* a, const void* b);
+static void write_program(const igh_program_t* program, uint8_t* pd);
+static void read_program(const igh_program_t* program, const uint8_t* pd);
+static int configure_dc(unsigned long long interval);
+static void sync_dc(void);
+static void measure_dc(void);
+static void publish_image(void);
+static unsigned long long image_time(void);
+static int compare_image_entry(const void* a, const void* b);
+static void monitor_bus(unsigned int due);
+static int optimize_pdos(const io_mapping_info_t* mapping_list, int mapping_count);
+static int build_sync(ec_sync_info_t* sync, const ec_sync_info_t* source, int slave, int direction,
+	const unsigned long long* key_list, int key_count);
+static void report_frame(const io_mapping_info_t* mapping_list, int mapping_count);
+static unsigned int sync_bit_length(const ec_sync_info_t* sync);
+static int compare_key(const void* a, const void* b);
 
 int igh_init(igh_slave_t** slave_list, int* slave_num)
 {
-	int i, j, k, l;
+	int i, pass;
 	int ret = 0;
+	int entry_count = 0;
+	int cache_miss = 0;
 
 	ec_master_info_t master_info;
 	ec_slave_config_t* slave = NULL;
-	ec_sync_info_t temp_sync_info;
-	ec_sync_info_t* target_sync_info = NULL;
+	igh_scan_t* scan_list;
 
 	*slave_list = NULL;
 	*slave_num = 0;
@@ -61,8 +334,8 @@ int igh_init(igh_slave_t** slave_list, int* slave_num)
 		return 1;
 	}
 
-	domain1 = ecrt_master_create_domain(master);
-	if(domain1 == NULL)
+	domain_count = 0;
+	if(get_domain(1) != 0)
 	{
 		printf("EtherCAT domain creation failed!\n");
 		igh_cleanup(slave_list);
@@ -77,99 +350,142 @@ int igh_init(igh_slave_t** slave_list, int* slave_num)
 		return -ret;
 	}
 
-	/* allocate momory for slave information and configuration */
 	slave_count = master_info.slave_count;
-	slave_info_list = (ec_slave_info_t*)malloc(sizeof(ec_slave_info_t) * slave_count);
-	input_sync_info_list = (ec_sync_info_t*)malloc(sizeof(ec_sync_info_t) * slave_count);
-	output_sync_info_list = (ec_sync_info_t*)malloc(sizeof(ec_sync_info_t) * slave_count);
-	memset(input_sync_info_list, 0, sizeof(ec_sync_info_t) * slave_count);
-	memset(output_sync_info_list, 0, sizeof(ec_sync_info_t) * slave_count);
+	load_cache();
 
-	/* allocate momory for slave list */
-	*slave_num = slave_count;
-	*slave_list = (igh_slave_t*)malloc(sizeof(igh_slave_t) * slave_count);
+	scan_list = (igh_scan_t*)calloc(slave_count + 1, sizeof(igh_scan_t));
+	if(scan_list == NULL)
+	{
+		printf("EtherCAT allocating the bus scan failed!\n");
+		igh_cleanup(slave_list);
+		return 1;
+	}
 
-	/* configure slaves */
+	/* walk the bus once, this also sizes the PDO and entry arrays */
+	arena_init(&topology_arena);
 	for(i = 0; i < slave_count; i++)
 	{
-		ret = ecrt_master_get_slave(master, i, &slave_info_list[i]);
+		ret = scan_slave(i, &scan_list[i], &entry_count);
 		if(ret != 0)
 		{
-			printf("EtherCAT slave information request failed!\n");
+			free_scan_list(scan_list, slave_count);
 			igh_cleanup(slave_list);
-			return -ret;
+			return ret;
 		}
+	}
 
-		slave = ecrt_master_slave_config(master, 0, i, slave_info_list[i].vendor_id, slave_info_list[i].product_code);
-		if(slave == NULL)
+	entry_index_bits = 4;
+	while((1U << entry_index_bits) < entry_count * 2)
+		entry_index_bits++;
+
+	/* the first pass only sizes the arena, the second one fills it */
+	for(pass = 0; pass < 2; pass++)
+	{
+		slave_info_list = (ec_slave_info_t*)arena_alloc(&topology_arena, sizeof(ec_slave_info_t) * slave_count);
+		input_sync_info_list = (ec_sync_info_t*)arena_alloc(&topology_arena, sizeof(ec_sync_info_t) * slave_count);
+		output_sync_info_list = (ec_sync_info_t*)arena_alloc(&topology_arena, sizeof(ec_sync_info_t) * slave_count);
+		*slave_list = (igh_slave_t*)arena_alloc(&topology_arena, sizeof(igh_slave_t) * slave_count);
+		entry_index = (igh_entry_slot_t*)arena_alloc(&topology_arena, sizeof(igh_entry_slot_t) << entry_index_bits);
+		slave_state_list = (uint8_t*)arena_alloc(&topology_arena, slave_count);
+		pdo_flexible_list = (uint8_t*)arena_alloc(&topology_arena, slave_count);
+
+		if(pass == 0 && arena_commit(&topology_arena) != 0)
 		{
-			printf("EtherCAT slave configuration failed!\n");
+			printf("EtherCAT allocating %u bytes for the topology failed!\n", (unsigned int)topology_arena.used);
+			free_scan_list(scan_list, slave_count);
 			igh_cleanup(slave_list);
 			return 1;
 		}
+	}
 
-		/* get PDO structure */
-		for(j = 0; j < slave_info_list[i].sync_count; j++)
+	for(i = 0; i < slave_count; i++)
+	{
+		slave_info_list[i] = scan_list[i].info;
+		ret = fill_slave(i, &scan_list[i], &input_sync_info_list[i], &output_sync_info_list[i]);
+		if(ret != 0)
 		{
-			ret = ecrt_master_get_sync_manager(master, i, j, &temp_sync_info);
-			if(ret != 0)
-			{
-				printf("EtherCAT getting sync structure failed!\n");
-				igh_cleanup(slave_list);
-				return ret;
-			}
-
-			target_sync_info = NULL;
-			if(temp_sync_info.dir == EC_DIR_INPUT && temp_sync_info.n_pdos != 0)
-			{
-				input_sync_info_list[i] = temp_sync_info;
-				target_sync_info = &input_sync_info_list[i];
-			}
-			if(temp_sync_info.dir == EC_DIR_OUTPUT && temp_sync_info.n_pdos != 0)
-			{
-				output_sync_info_list[i] = temp_sync_info;
-				target_sync_info = &output_sync_info_list[i];
-			}
-
-			if(target_sync_info != NULL)
-			{
-				target_sync_info -> pdos = (ec_pdo_info_t*)malloc(sizeof(ec_pdo_info_t) * target_sync_info -> n_pdos);
-				for(k = 0; k < target_sync_info -> n_pdos; k++)
-				{
-					ret = ecrt_master_get_pdo(master, i, j, k, &(target_sync_info -> pdos[k]));
-					if(ret != 0)
-					{
-						printf("EtherCAT getting PDO structure failed!\n");
-						igh_cleanup(slave_list);
-						return ret;
-					}
-
-					target_sync_info -> pdos[k].entries =
-						(ec_pdo_entry_info_t*)malloc(sizeof(ec_pdo_entry_info_t) * target_sync_info -> pdos[k].n_entries);
-
-					for(l = 0; l < target_sync_info -> pdos[k].n_entries; l++)
-					{
-						ret = ecrt_master_get_pdo_entry(master, i, j, k, l, &(target_sync_info -> pdos[k].entries[l]));
-						if(ret != 0)
-						{
-							printf("EtherCAT getting PDO entry structure failed!\n");
-							igh_cleanup(slave_list);
-							return ret;
-						}
-					}
-				}
-			}
+			free_scan_list(scan_list, slave_count);
+			igh_cleanup(slave_list);
+			return ret;
+		}
+		cache_miss += !scan_list[i].cached;
+	}
+	free_scan_list(scan_list, slave_count);
 
-			if(input_sync_info_list[i].pdos != NULL && output_sync_info_list[i].pdos != NULL)
-				break;
+	/* configure slaves */
+	*slave_num = slave_count;
+	dc_slave_list = *slave_list;
+	bus_slave_list = *slave_list;
+	for(i = 0; i < slave_count; i++)
+	{
+		slave = ecrt_master_slave_config(master, 0, i, slave_info_list[i].vendor_id, slave_info_list[i].product_code);
+		if(slave == NULL)
+		{
+			printf("EtherCAT slave configuration failed!\n");
+			igh_cleanup(slave_list);
+			return 1;
 		}
 
 		(*slave_list)[i].position = i;
+		(*slave_list)[i].config_p = slave;
+		(*slave_list)[i].dc_assign_activate = 0;
 		(*slave_list)[i].info_p = &slave_info_list[i];
 		(*slave_list)[i].input_sync_info_p = &input_sync_info_list[i];
 		(*slave_list)[i].output_sync_info_p = &output_sync_info_list[i];
 	}
 
+	if(cache_path[0] != '\0' && (cache == NULL || cache_miss != 0) && save_cache() != 0)
+		printf("EtherCAT writing topology cache %s failed!\n", cache_path);
+	if(cache != NULL)
+	{
+		munmap(cache, cache_size);
+		cache = NULL;
+	}
+
+	build_entry_index();
+
+	return 0;
+}
+
+int igh_set_topology_cache(const char* path)
+{
+	if(path == NULL)
+		path = "";
+	if(strlen(path) >= sizeof(cache_path))
+		return 1;
+
+	strcpy(cache_path, path);
+	return 0;
+}
+
+int igh_pdo_optimize(const int* position_list, int position_count)
+{
+	int i;
+
+	if(master == NULL || pdo_registered)
+		return 1;
+
+	memset(pdo_flexible_list, 0, slave_count);
+	for(i = 0; i < position_count; i++)
+	{
+		if(position_list[i] < 0 || position_list[i] >= slave_count)
+		{
+			printf("EtherCAT cannot find slave %d! (max : %d)\n", position_list[i], slave_count - 1);
+			memset(pdo_flexible_list, 0, slave_count);
+			return 1;
+		}
+		pdo_flexible_list[position_list[i]] = 1;
+	}
+
+	return 0;
+}
+
+int igh_pdo_report(io_pdo_report_t* report)
+{
+	if(!pdo_registered)
+		return 1;
+
+	*report = pdo_report;
 	return 0;
 }
 
@@ -178,16 +494,22 @@ int igh_mapping(io_mapping_info_t* mapping_list, int mapping_count)
 	int i, ret;
 	int ic = 0;
 	int oc = 0;
+	int dc = 0;
+	int d, n;
 	igh_value_t* temp_target = NULL;
+	ec_pdo_entry_reg_t* domain_reg = NULL;
+	int* mapping_domain = NULL;
 
 	int slave, index, subindex;
 
-	if(input_count != 0 || output_count != 0)
+	if(input_count != 0 || output_count != 0 || direct_count != 0)
 		clear_inout_list();
 
 	for(i = 0; i < mapping_count; i++)
 	{
-		if(mapping_list[i].direction == 1)
+		if(mapping_list[i].mode == IO_MAPPING_DIRECT)
+			direct_count++;
+		else if(mapping_list[i].direction == 1)
 			input_count++;
 		else if(mapping_list[i].direction == 0)
 			output_count++;
@@ -196,21 +518,50 @@ int igh_mapping(io_mapping_info_t* mapping_list, int mapping_count)
 	pdo_entry_reg = (ec_pdo_entry_reg_t*)malloc(sizeof(ec_pdo_entry_reg_t) * (mapping_count + 1));
 	input_list = (igh_value_t*)malloc(sizeof(igh_value_t) * input_count);
 	output_list = (igh_value_t*)malloc(sizeof(igh_value_t) * output_count);
+	direct_list = (igh_value_t*)malloc(sizeof(igh_value_t) * direct_count);
+	mapping_domain = (int*)malloc(sizeof(int) * (mapping_count + 1));
 
 	for(i = 0; i < mapping_count; i++)
 	{
-		if(mapping_list[i].direction == 1)
+		if(mapping_list[i].mode == IO_MAPPING_DIRECT)
+			temp_target = &direct_list[dc++];
+		else if(mapping_list[i].direction == 1)
 			temp_target = &input_list[ic++];
 		else if(mapping_list[i].direction == 0)
 			temp_target = &output_list[oc++];
 
 		temp_target -> variable = mapping_list[i].model_addr;
 		temp_target -> size = mapping_list[i].size;
+		temp_target -> domain = get_domain(mapping_list[i].rate_group);
+		if(temp_target -> domain < 0)
+		{
+			printf("EtherCAT domain creation for rate group %d failed!\n", mapping_list[i].rate_group);
+			free(mapping_domain);
+			clear_inout_list();
+			return 1;
+		}
+		mapping_domain[i] = temp_target -> domain;
+
+		if(mapping_list[i].network_addr != NULL)
+			sscanf(mapping_list[i].network_addr, "%d:0x%x:0x%x", &slave, &index, &subindex);
+		else if(mapping_list[i].addr.role == IO_ROLE_OBJECT)
+		{
+			slave = mapping_list[i].addr.slave;
+			index = mapping_list[i].addr.index;
+			subindex = mapping_list[i].addr.subindex;
+		}
+		else
+		{
+			printf("EtherCAT role %d of slave %d is not an object!\n", mapping_list[i].addr.role, mapping_list[i].addr.slave);
+			free(mapping_domain);
+			clear_inout_list();
+			return 1;
+		}
 
-		sscanf(mapping_list[i].network_addr, "%d:0x%x:0x%x", &slave, &index, &subindex);
-		if(slave >= slave_count)
+		if(slave < 0 || slave >= slave_count)
 		{
 			printf("EtherCAT cannot find slave %d! (max : %d)\n", slave, slave_count - 1);
+			free(mapping_domain);
 			clear_inout_list();
 			return 1;
 		}
@@ -224,213 +575,1829 @@ int igh_mapping(io_mapping_info_t* mapping_list, int mapping_count)
 		pdo_entry_reg[i].offset = &(temp_target -> offset);
 		pdo_entry_reg[i].bit_position = &(temp_target -> bit_pos);
 
-		temp_target -> bit_length = get_pdo_bit_length(slave, index, subindex, mapping_list[i].direction);
+		temp_target -> entry = find_entry(slave, index, subindex, mapping_list[i].direction);
+		temp_target -> bit_length = temp_target -> entry != NULL ? temp_target -> entry -> bit_length : 0;
 		if(temp_target -> bit_length == 0)
 		{
 			printf("EtherCAT getting bit length of (%x, %x) object failed!\n", index, subindex);
+			free(mapping_domain);
 			clear_inout_list();
 			return 1;
 		}
-		if((temp_target -> bit_length / 8) > mapping_list[i].size)
+		if(mapping_list[i].network_addr == NULL && mapping_list[i].addr.bit_length != 0 &&
+			mapping_list[i].addr.bit_length != temp_target -> bit_length)
+		{
+			printf("EtherCAT (%x, %x) object has %u bits, not %d!\n", index, subindex,
+				temp_target -> bit_length, mapping_list[i].addr.bit_length);
+			free(mapping_domain);
+			clear_inout_list();
+			return 1;
+		}
+		/* entries without variable are only registered for igh_remap() */
+		if(temp_target -> variable != NULL && (temp_target -> bit_length / 8) > mapping_list[i].size)
 		{
 			printf("EtherCAT not enough size of model variable.\n");
+			free(mapping_domain);
 			clear_inout_list();
 			return 1;
 		}
 	}
 
-	memset(&(pdo_entry_reg[mapping_count]), 0, sizeof(ec_pdo_entry_reg_t));
-	ret = ecrt_domain_reg_pdo_entry_list(domain1, pdo_entry_reg);
-	if(ret != 0)
+	/* flexible slaves only transmit what is mapped */
+	if(optimize_pdos(mapping_list, mapping_count) != 0)
 	{
-		printf("EtherCAT PDO registration failed!\n");
+		free(mapping_domain);
 		clear_inout_list();
-		return ret;
+		return 1;
+	}
+
+	/* register entries of every rate group into its own domain */
+	pdo_registered = 1;
+	domain_reg = (ec_pdo_entry_reg_t*)malloc(sizeof(ec_pdo_entry_reg_t) * (mapping_count + 1));
+	for(d = 0; d < domain_count; d++)
+	{
+		n = 0;
+		for(i = 0; i < mapping_count; i++)
+		{
+			if(mapping_domain[i] == d)
+				domain_reg[n++] = pdo_entry_reg[i];
+		}
+		if(n == 0)
+			continue;
+
+		memset(&(domain_reg[n]), 0, sizeof(ec_pdo_entry_reg_t));
+		ret = ecrt_domain_reg_pdo_entry_list(domain_list[d].domain, domain_reg);
+		if(ret != 0)
+		{
+			printf("EtherCAT PDO registration failed!\n");
+			free(domain_reg);
+			free(mapping_domain);
+			clear_inout_list();
+			return ret;
+		}
+		domain_list[d].entry_count += n;
+	}
+	free(domain_reg);
+	free(mapping_domain);
+	report_frame(mapping_list, mapping_count);
+	record_registration(input_list, input_count);
+	record_registration(output_list, output_count);
+	record_registration(direct_list, direct_count);
+
+	/* direct entries must match the model variable in the frame buffer */
+	for(i = 0; i < direct_count; i++)
+	{
+		if(direct_list[i].variable == NULL)
+			continue;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		if(direct_list[i].bit_pos == 0 && direct_list[i].offset % direct_list[i].size == 0 &&
+			(direct_list[i].bit_length == 8 || direct_list[i].bit_length == 16 || direct_list[i].bit_length == 32) &&
+			direct_list[i].bit_length / 8 == direct_list[i].size)
+			continue;
+#endif
+		printf("EtherCAT direct mapping of %u bit object at %u.%u is not possible!\n",
+			direct_list[i].bit_length, direct_list[i].offset, direct_list[i].bit_pos);
+		clear_inout_list();
+		return 1;
+	}
+
+	/* offsets are known after registration, compile copy programs */
+	for(d = 0; d < domain_count; d++)
+	{
+		if(compile_program(&(domain_list[d].input_program), input_list, input_count, d) != 0 ||
+			compile_program(&(domain_list[d].output_program), output_list, output_count, d) != 0)
+		{
+			printf("EtherCAT compiling copy program failed!\n");
+			clear_inout_list();
+			return 1;
+		}
 	}
 
 	return 0;
 }
 
-int igh_activate(unsigned long long interval)
+int igh_mapping_report(io_mapping_report_t* report)
 {
-	int ret;
+	int i;
 
-	ret = ecrt_master_set_send_interval(master, interval);
-	if(ret != 0)
+	if(pdo_entry_reg == NULL)
+		return 1;
+
+	/* entries registered without a model variable are not exchanged */
+	memset(report, 0, sizeof(io_mapping_report_t));
+	for(i = 0; i < input_count; i++)
 	{
-		printf("EtherCAT setting send interval failed!\n");
-		return -ret;
+		report -> entry_count += input_list[i].variable != NULL;
+		report -> bit_entry_count += input_list[i].variable != NULL && input_list[i].bit_length < 8;
 	}
-
-	ret = ecrt_master_activate(master);
-	if(ret != 0)
+	for(i = 0; i < output_count; i++)
 	{
-		printf("EtherCAT master activation failed!\n");
-		return -ret;
+		report -> entry_count += output_list[i].variable != NULL;
+		report -> bit_entry_count += output_list[i].variable != NULL && output_list[i].bit_length < 8;
 	}
-
-	domain1_pd = ecrt_domain_data(domain1);
-	if(domain1_pd == NULL)
+	for(i = 0; i < direct_count; i++)
 	{
-		printf("EtherCAT mapping process data failed!\n");
-		return 1;
+		report -> entry_count++;
+		report -> bit_entry_count += direct_list[i].bit_length < 8;
 	}
 
 	return 0;
 }
 
-int igh_exchange(void)
+int igh_remap(io_mapping_info_t* mapping_list, int mapping_count)
 {
-	int i;
+	int i, d, direction;
+	int ret = 0;
+	int pending;
+	int value_count[2] = {0, 0};
+	igh_value_t* value_list[2];
+	igh_value_t* value;
+	igh_entry_slot_t* entry;
+	int slave, index, subindex;
+	unsigned int divider;
+	struct timespec wait = {0, IGH_REMAP_WAIT_NS};
 
-	ecrt_master_receive(master);
-	ecrt_domain_process(domain1);
+	if(master == NULL || entry_index == NULL || __atomic_load_n(&remap_pending, __ATOMIC_ACQUIRE) != 0)
+		return 1;
 
-	for(i = 0; i < output_count; i++)
+	for(i = 0; i < mapping_count; i++)
 	{
-		switch(output_list[i].bit_length)
+		if(mapping_list[i].mode == IO_MAPPING_DIRECT)
 		{
-			case 1 :
-				EC_WRITE_BIT(domain1_pd + output_list[i].offset, output_list[i].bit_pos, *((char*)output_list[i].variable));
-				break;
-			case 8 :
-				EC_WRITE_U8(domain1_pd + output_list[i].offset, *((char*)output_list[i].variable));
-				break;
-			case 16 :
-				EC_WRITE_U16(domain1_pd + output_list[i].offset, *((short*)output_list[i].variable));
-				break;
-			case 32 :
-				EC_WRITE_U32(domain1_pd + output_list[i].offset, *((int*)output_list[i].variable));
-				break;
+			printf("EtherCAT direct entries cannot be remapped online!\n");
+			return 1;
 		}
+		if(mapping_list[i].direction == 0 || mapping_list[i].direction == 1)
+			value_count[mapping_list[i].direction]++;
 	}
 
-	ecrt_domain_queue(domain1);
-	ecrt_master_send(master);
+	/* index 0 holds the outputs, 1 the inputs, like the direction */
+	value_list[0] = (igh_value_t*)malloc(sizeof(igh_value_t) * (value_count[0] + 1));
+	value_list[1] = (igh_value_t*)malloc(sizeof(igh_value_t) * (value_count[1] + 1));
+	if(value_list[0] == NULL || value_list[1] == NULL)
+	{
+		free(value_list[0]);
+		free(value_list[1]);
+		return 1;
+	}
+	value_count[0] = 0;
+	value_count[1] = 0;
 
-	for(i = 0; i < input_count; i++)
+	for(i = 0; i < mapping_count && ret == 0; i++)
 	{
-		switch(input_list[i].bit_length)
+		direction = mapping_list[i].direction;
+		if(direction != 0 && direction != 1)
+			continue;
+
+		/* only objects registered by igh_mapping() can be bound */
+		if(mapping_list[i].network_addr != NULL)
 		{
-			case 1 :
-				*((char*)(input_list[i].variable)) = EC_READ_BIT(domain1_pd + input_list[i].offset, input_list[i].bit_pos);
-				break;
-			case 8 :
-				*((char*)(input_list[i].variable)) = EC_READ_U8(domain1_pd + input_list[i].offset);
-				break;
-			case 16 :
-				*((short*)(input_list[i].variable)) = EC_READ_U16(domain1_pd + input_list[i].offset);
-				break;
-			case 32 :
-				*((int*)(input_list[i].variable)) = EC_READ_U32(domain1_pd + input_list[i].offset);
+			if(sscanf(mapping_list[i].network_addr, "%d:0x%x:0x%x", &slave, &index, &subindex) != 3)
+			{
+				printf("EtherCAT %s cannot be remapped online!\n", mapping_list[i].network_addr);
+				ret = 1;
 				break;
+			}
+		}
+		else if(mapping_list[i].addr.role == IO_ROLE_OBJECT)
+		{
+			slave = mapping_list[i].addr.slave;
+			index = mapping_list[i].addr.index;
+			subindex = mapping_list[i].addr.subindex;
+		}
+		else
+		{
+			printf("EtherCAT role %d of slave %d cannot be remapped online!\n", mapping_list[i].addr.role, mapping_list[i].addr.slave);
+			ret = 1;
+			break;
+		}
+
+		entry = slave >= 0 && slave < slave_count ? find_entry(slave, index, subindex, direction) : NULL;
+		if(entry == NULL || entry -> domain < 0)
+		{
+			printf("EtherCAT (%x, %x) object of slave %d is not registered!\n", index, subindex, slave);
+			ret = 1;
+			break;
+		}
+
+		divider = mapping_list[i].rate_group > 1 ? mapping_list[i].rate_group : 1;
+		if(domain_list[entry -> domain].divider != divider)
+		{
+			printf("EtherCAT (%x, %x) object of slave %d is registered in rate group %u!\n", index, subindex, slave,
+				domain_list[entry -> domain].divider);
+			ret = 1;
+			break;
+		}
+
+		if(mapping_list[i].model_addr != NULL && (entry -> bit_length / 8) > mapping_list[i].size)
+		{
+			printf("EtherCAT not enough size of model variable.\n");
+			ret = 1;
+			break;
 		}
+
+		value = &value_list[direction][value_count[direction]++];
+		value -> variable = mapping_list[i].model_addr;
+		value -> size = mapping_list[i].size;
+		value -> offset = entry -> offset;
+		value -> bit_pos = entry -> bit_pos;
+		value -> bit_length = entry -> bit_length;
+		value -> domain = entry -> domain;
+		value -> entry = entry;
 	}
 
-	return 0;
-}
+	for(d = 0; d < domain_count && ret == 0; d++)
+	{
+		if(compile_program(&(domain_list[d].next_input_program), value_list[1], value_count[1], d) != 0 ||
+			compile_program(&(domain_list[d].next_output_program), value_list[0], value_count[0], d) != 0)
+		{
+			printf("EtherCAT compiling copy program failed!\n");
+			ret = 1;
+		}
+	}
+	free(value_list[0]);
+	free(value_list[1]);
 
-int igh_cleanup(igh_slave_t** slave_list)
-{
-	if(master != NULL)
+	if(ret != 0)
 	{
-		ecrt_release_master(master);
-		master = NULL;
+		free_next_programs();
+		return ret;
 	}
 
-	if(slave_info_list != NULL)
+	/* nothing is cycling before activation */
+	if(!master_active)
 	{
-		free(slave_info_list);
-		slave_info_list = NULL;
+		swap_programs();
+		free_next_programs();
+		return 0;
 	}
 
-	free_sync_info_list(input_sync_info_list);
-	input_sync_info_list = NULL;
-	free_sync_info_list(output_sync_info_list);
-	output_sync_info_list = NULL;
-	clear_inout_list();
+	/* the cycle swaps the programs at its next igh_receive() */
+	__atomic_store_n(&remap_pending, 1, __ATOMIC_RELEASE);
+	for(i = 0; i < IGH_REMAP_WAIT_STEPS && __atomic_load_n(&remap_pending, __ATOMIC_ACQUIRE) != 0; i++)
+		nanosleep(&wait, NULL);
 
-	if(*slave_list != NULL)
+	/* withdraw the programs unless the cycle is already swapping them */
+	pending = 1;
+	if(__atomic_compare_exchange_n(&remap_pending, &pending, 0, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
 	{
-		free(*slave_list);
-		*slave_list = NULL;
+		printf("EtherCAT remapping was not taken by the cycle!\n");
+		ret = 1;
 	}
+	while(__atomic_load_n(&remap_pending, __ATOMIC_ACQUIRE) != 0)
+		nanosleep(&wait, NULL);
 
-	return 0;
+	/* the old programs after a swap, the withdrawn ones otherwise */
+	free_next_programs();
+
+	return ret;
 }
 
-static unsigned int get_pdo_bit_length(uint16_t slave, uint16_t index, uint8_t subindex, int direction)
+int igh_activate(unsigned long long interval)
 {
-	int i, j;
-	ec_sync_info_t* temp_sync_info;
-
-	if(direction == 1)
-		temp_sync_info = &input_sync_info_list[slave];
-	else if(direction == 0)
-		temp_sync_info = &output_sync_info_list[slave];
-
-	if(temp_sync_info -> pdos == NULL)
-		return 0;
+	int i, ret;
 
-	for(i = 0; i < temp_sync_info -> n_pdos; i++)
+	ret = ecrt_master_set_send_interval(master, interval);
+	if(ret != 0)
+	{
+		printf("EtherCAT setting send interval failed!\n");
+		return -ret;
+	}
+	exchange_interval = interval;
+
+	/* DC has to be configured before activation */
+	ret = configure_dc(interval);
+	if(ret != 0)
+		return ret;
+
+	ret = ecrt_master_activate(master);
+	if(ret != 0)
+	{
+		printf("EtherCAT master activation failed!\n");
+		return -ret;
+	}
+
+	for(i = 0; i < domain_count; i++)
+	{
+		domain_list[i].pd = ecrt_domain_data(domain_list[i].domain);
+		if(domain_list[i].pd == NULL && domain_list[i].entry_count != 0)
+		{
+			printf("EtherCAT mapping process data failed!\n");
+			return 1;
+		}
+	}
+	exchange_cycle = 0;
+	in_flight = 0;
+
+	/* the first check of every slave only records its state */
+	memset(&status, 0, sizeof(io_status_t));
+	status.link_up = -1;
+	status.slave_count = slave_count;
+	status.domain_count = domain_count;
+	for(i = 0; i < domain_count; i++)
+		status.rate_group[i] = domain_list[i].divider;
+	status.last_slave = -1;
+	memset(slave_state_list, IGH_SLAVE_STATE_UNKNOWN, slave_count);
+	monitor_countdown = 0;
+	monitor_next = -1;
+
+	/* hand out process image locations of direct entries */
+	for(i = 0; i < direct_count; i++)
+	{
+		if(direct_list[i].variable != NULL)
+			*((void**)direct_list[i].variable) = domain_list[direct_list[i].domain].pd + direct_list[i].offset;
+	}
+	master_active = 1;
+
+	return 0;
+}
+
+int igh_exchange(void)
+{
+	int ret;
+
+	ret = igh_receive();
+	if(ret != 0)
+		return ret;
+
+	return igh_send();
+}
+
+int igh_receive(void)
+{
+	int i;
+	int pending;
+	unsigned int due = in_flight;
+	PROF_START(tick);
+
+	/* only domains sent by the last igh_send() carry new data */
+	in_flight = 0;
+
+	/* take the programs of igh_remap() at the cycle boundary */
+	if(__atomic_load_n(&remap_pending, __ATOMIC_RELAXED) == 1)
+	{
+		pending = 1;
+		if(__atomic_compare_exchange_n(&remap_pending, &pending, 2, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		{
+			swap_programs();
+			__atomic_store_n(&remap_pending, 0, __ATOMIC_RELEASE);
+		}
+	}
+
+	ecrt_master_receive(master);
+	if(dc_active)
+		measure_dc();
+	PROF_MARK(tick, PROF_RECEIVE);
+	for(i = 0; i < domain_count; i++)
+	{
+		if(due & (1 << i))
+			ecrt_domain_process(domain_list[i].domain);
+	}
+	PROF_MARK(tick, PROF_PROCESS);
+
+	for(i = 0; i < domain_count; i++)
+	{
+		if(due & (1 << i))
+			read_program(&(domain_list[i].input_program), domain_list[i].pd);
+	}
+	PROF_MARK(tick, PROF_READ);
+
+	monitor_bus(due);
+	PROF_MARK(tick, PROF_MONITOR);
+
+	return 0;
+}
+
+int igh_send(void)
+{
+	int i;
+	unsigned int due = 0;
+	PROF_START(tick);
+
+	/* domains of slower rate groups are skipped until their cycle */
+	for(i = 0; i < domain_count; i++)
+	{
+		if(domain_list[i].entry_count != 0 && exchange_cycle % domain_list[i].divider == 0)
+			due |= 1 << i;
+	}
+	exchange_cycle++;
+
+	for(i = 0; i < domain_count; i++)
+	{
+		if(due & (1 << i))
+			write_program(&(domain_list[i].output_program), domain_list[i].pd);
+	}
+	PROF_MARK(tick, PROF_WRITE);
+
+	for(i = 0; i < domain_count; i++)
+	{
+		if(due & (1 << i))
+			ecrt_domain_queue(domain_list[i].domain);
+	}
+	PROF_MARK(tick, PROF_QUEUE);
+	if(dc_active)
+		sync_dc();
+	ecrt_master_send(master);
+	PROF_MARK(tick, PROF_SEND);
+
+	in_flight = due;
+
+	if(__atomic_load_n(&(image.header), __ATOMIC_ACQUIRE) != NULL)
+		publish_image();
+	recorder_sample(exchange_cycle);
+
+	return 0;
+}
+
+int igh_publish_image(const char* name)
+{
+	int i, n;
+	int entry_count = 0;
+	unsigned int data_size = 0;
+	unsigned long long key;
+	image_t new_image;
+	image_entry_t* entry_list;
+	igh_entry_slot_t* slot;
+
+	if(!master_active || image.header != NULL)
+		return 1;
+
+	/* domains are laid out one after the other, 8 byte aligned */
+	for(i = 0; i < domain_count; i++)
+	{
+		domain_list[i].size = domain_list[i].pd != NULL ? ecrt_domain_size(domain_list[i].domain) : 0;
+		domain_list[i].image_offset = data_size;
+		data_size += (domain_list[i].size + 7) & ~7U;
+	}
+
+	for(i = 0; i < (1 << entry_index_bits); i++)
+	{
+		if(entry_index[i].key != 0 && entry_index[i].domain >= 0)
+			entry_count++;
+	}
+
+	/* the cycle is running, it only sees the image once it is complete */
+	if(image_create(&new_image, name, entry_count, data_size) != 0)
+	{
+		printf("EtherCAT creating process image %s failed!\n", name);
+		return 1;
+	}
+
+	entry_list = image_entry_list(&new_image);
+	for(i = 0, n = 0; i < (1 << entry_index_bits); i++)
+	{
+		slot = &entry_index[i];
+		if(slot -> key == 0 || slot -> domain < 0)
+			continue;
+
+		key = slot -> key;
+		entry_list[n].slave = (key >> 32) & 0xffff;
+		entry_list[n].index = (key >> 16) & 0xffff;
+		entry_list[n].subindex = (key >> 8) & 0xff;
+		entry_list[n].direction = key & 0xff;
+		entry_list[n].bit_pos = slot -> bit_pos;
+		entry_list[n].bit_length = slot -> bit_length;
+		entry_list[n].offset = domain_list[slot -> domain].image_offset + slot -> offset;
+		n++;
+	}
+	qsort(entry_list, entry_count, sizeof(image_entry_t), compare_image_entry);
+	image_ready(&new_image);
+
+	/* the header goes last, only the cycle writes snapshots */
+	image.size = new_image.size;
+	image.owner = new_image.owner;
+	memcpy(image.name, new_image.name, sizeof(image.name));
+	__atomic_store_n(&(image.header), new_image.header, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+int igh_record_start(const char* path, const io_addr_t* addr_list, int addr_count, int depth)
+{
+	int i;
+	int ret;
+	igh_entry_slot_t* entry;
+	recorder_column_t* column_list;
+
+	if(!master_active || addr_count <= 0)
+		return 1;
+
+	column_list = (recorder_column_t*)malloc(sizeof(recorder_column_t) * addr_count);
+	if(column_list == NULL)
+		return 1;
+
+	for(i = 0; i < addr_count; i++)
+	{
+		/* inputs first, an object is rarely mapped in both directions */
+		entry = NULL;
+		if(addr_list[i].role == IO_ROLE_OBJECT && addr_list[i].slave >= 0 && addr_list[i].slave < slave_count)
+		{
+			entry = find_entry(addr_list[i].slave, addr_list[i].index, addr_list[i].subindex, 1);
+			if(entry == NULL || entry -> domain < 0)
+				entry = find_entry(addr_list[i].slave, addr_list[i].index, addr_list[i].subindex, 0);
+		}
+		if(entry == NULL || entry -> domain < 0)
+		{
+			printf("EtherCAT (%x, %x) object of slave %d is not registered!\n",
+				addr_list[i].index, addr_list[i].subindex, addr_list[i].slave);
+			free(column_list);
+			return 1;
+		}
+		if(entry -> bit_length > 32)
+		{
+			printf("EtherCAT %u bit entries cannot be recorded!\n", entry -> bit_length);
+			free(column_list);
+			return 1;
+		}
+
+		column_list[i].entry.slave = addr_list[i].slave;
+		column_list[i].entry.index = addr_list[i].index;
+		column_list[i].entry.subindex = addr_list[i].subindex;
+		column_list[i].entry.direction = entry -> key & 0xff;
+		column_list[i].entry.bit_pos = entry -> bit_pos;
+		column_list[i].entry.bit_length = entry -> bit_length;
+		column_list[i].source = domain_list[entry -> domain].pd + entry -> offset;
+	}
+
+	ret = recorder_start(path, column_list, addr_count, depth, exchange_interval);
+	if(ret != 0)
+		printf("EtherCAT starting recorder to %s failed!\n", path);
+	free(column_list);
+
+	return ret;
+}
+
+int igh_record_stop(void)
+{
+	return recorder_stop();
+}
+
+int igh_monitor(int period)
+{
+	if(period < 0)
+		return 1;
+
+	__atomic_store_n(&monitor_period, period, __ATOMIC_RELAXED);
+	return 0;
+}
+
+int igh_status(io_status_t* copy)
+{
+	int i;
+	uint32_t sequence;
+
+	if(!__atomic_load_n(&master_active, __ATOMIC_ACQUIRE))
+		return 1;
+
+	/* seqlock : retry while the cycle updates the status */
+	for(i = 0; i < IGH_STATUS_READ_RETRY; i++)
+	{
+		sequence = __atomic_load_n(&status_sequence, __ATOMIC_ACQUIRE);
+		if(sequence & 1)
+			continue;
+
+		memcpy(copy, &status, sizeof(io_status_t));
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&status_sequence, __ATOMIC_RELAXED) == sequence)
+			return 0;
+	}
+
+	return 1;
+}
+
+int igh_dc_configure(int mode, int shift)
+{
+	if(mode < IO_DC_OFF || mode > IO_DC_MASTER_SHIFT)
+		return 1;
+
+	dc_mode = mode;
+	dc_shift = shift;
+
+	return 0;
+}
+
+long long igh_dc_sync(unsigned long long app_time)
+{
+	dc_app_time = app_time;
+	dc_time_set = 1;
+
+	/* the bus follows the master in bus shift mode */
+	if(dc_mode != IO_DC_MASTER_SHIFT)
+		return 0;
+
+	return dc_stat.offset;
+}
+
+int igh_dc_stat(io_dc_stat_t* stat)
+{
+	if(!dc_active)
+		return 1;
+
+	*stat = dc_stat;
+	return 0;
+}
+
+int igh_cleanup(igh_slave_t** slave_list)
+{
+	if(master != NULL)
+	{
+		ecrt_release_master(master);
+		master = NULL;
+	}
+
+	/* domains are released with the master */
+	clear_inout_list();
+	memset(domain_list, 0, sizeof(domain_list));
+	domain_count = 0;
+
+	dc_slave_list = NULL;
+	bus_slave_list = NULL;
+	slave_state_list = NULL;
+	pdo_flexible_list = NULL;
+	pdo_registered = 0;
+	dc_active = 0;
+	dc_time_set = 0;
+	master_active = 0;
+	remap_pending = 0;
+	image_close(&image);
+	recorder_stop();
+
+	if(cache != NULL)
+	{
+		munmap(cache, cache_size);
+		cache = NULL;
+	}
+
+	/* all topology data lives in one block */
+	arena_free(&topology_arena);
+	slave_info_list = NULL;
+	input_sync_info_list = NULL;
+	output_sync_info_list = NULL;
+	entry_index = NULL;
+	*slave_list = NULL;
+
+	return 0;
+}
+
+static igh_entry_slot_t* find_entry(uint16_t slave, uint16_t index, uint8_t subindex, int direction)
+{
+	unsigned long long key;
+	unsigned int mask, slot;
+
+	if(entry_index == NULL || (direction != 0 && direction != 1))
+		return NULL;
+
+	key = entry_key(slave, index, subindex, direction);
+	mask = (1U << entry_index_bits) - 1;
+	for(slot = entry_hash(key); entry_index[slot].key != 0; slot = (slot + 1) & mask)
+	{
+		if(entry_index[slot].key == key)
+			return &entry_index[slot];
+	}
+
+	return NULL;
+}
+
+/* slave information and sync manager and PDO headers, from the topology
+	cache if the slave is unchanged, sizing its blocks of the arena */
+static int scan_slave(int position, igh_scan_t* scan, int* entry_count)
+{
+	int j, k, d;
+	int ret;
+	ec_sync_info_t temp_sync_info;
+	ec_sync_info_t* target_sync_info;
+
+	ret = ecrt_master_get_slave(master, position, &(scan -> info));
+	if(ret != 0)
+	{
+		printf("EtherCAT slave information request failed!\n");
+		return -ret;
+	}
+
+	if(cache != NULL && load_cached_slave(&(scan -> info), position, &(scan -> sync[1]), &(scan -> sync[0]), entry_count) == 0)
+	{
+		scan -> cached = 1;
+		return 0;
+	}
+	memset(scan -> sync, 0, sizeof(scan -> sync));
+
+	for(j = 0; j < scan -> info.sync_count; j++)
+	{
+		ret = ecrt_master_get_sync_manager(master, position, j, &temp_sync_info);
+		if(ret != 0)
+		{
+			printf("EtherCAT getting sync structure failed!\n");
+			return ret;
+		}
+
+		d = -1;
+		if(temp_sync_info.dir == EC_DIR_OUTPUT && temp_sync_info.n_pdos != 0)
+			d = 0;
+		if(temp_sync_info.dir == EC_DIR_INPUT && temp_sync_info.n_pdos != 0)
+			d = 1;
+
+		if(d >= 0)
+		{
+			target_sync_info = &(scan -> sync[d]);
+			free(target_sync_info -> pdos);
+			*target_sync_info = temp_sync_info;
+			scan -> position[d] = j;
+
+			target_sync_info -> pdos = (ec_pdo_info_t*)malloc(sizeof(ec_pdo_info_t) * target_sync_info -> n_pdos);
+			if(target_sync_info -> pdos == NULL)
+			{
+				printf("EtherCAT allocating PDO headers of slave %d failed!\n", position);
+				return 1;
+			}
+			arena_alloc(&topology_arena, sizeof(ec_pdo_info_t) * target_sync_info -> n_pdos);
+
+			for(k = 0; k < target_sync_info -> n_pdos; k++)
+			{
+				ret = ecrt_master_get_pdo(master, position, j, k, &(target_sync_info -> pdos[k]));
+				if(ret != 0)
+				{
+					printf("EtherCAT getting PDO structure failed!\n");
+					return ret;
+				}
+
+				*entry_count += target_sync_info -> pdos[k].n_entries;
+				arena_alloc(&topology_arena, sizeof(ec_pdo_entry_info_t) * target_sync_info -> pdos[k].n_entries);
+			}
+		}
+
+		if(scan -> sync[0].n_pdos != 0 && scan -> sync[1].n_pdos != 0)
+			break;
+	}
+
+	return 0;
+}
+
+/* copy the scanned headers into the arena and read the PDO entries */
+static int fill_slave(int position, const igh_scan_t* scan,
+	ec_sync_info_t* input_sync_info, ec_sync_info_t* output_sync_info)
+{
+	int d, k, l;
+	int ret;
+	int entry_count = 0;
+	const ec_sync_info_t* source;
+	ec_sync_info_t* target_sync_info;
+
+	if(scan -> cached)
+	{
+		if(load_cached_slave(&(scan -> info), position, input_sync_info, output_sync_info, &entry_count) != 0)
+		{
+			printf("EtherCAT loading slave %d from the topology cache failed!\n", position);
+			return 1;
+		}
+		return 0;
+	}
+
+	for(d = 0; d < 2; d++)
+	{
+		source = &(scan -> sync[d]);
+		if(source -> n_pdos == 0)
+			continue;
+
+		target_sync_info = d ? input_sync_info : output_sync_info;
+		*target_sync_info = *source;
+		target_sync_info -> pdos = (ec_pdo_info_t*)arena_alloc(&topology_arena, sizeof(ec_pdo_info_t) * source -> n_pdos);
+		if(target_sync_info -> pdos == NULL)
+			return 1;
+
+		for(k = 0; k < source -> n_pdos; k++)
+		{
+			target_sync_info -> pdos[k] = source -> pdos[k];
+			target_sync_info -> pdos[k].entries =
+				(ec_pdo_entry_info_t*)arena_alloc(&topology_arena, sizeof(ec_pdo_entry_info_t) * source -> pdos[k].n_entries);
+			if(target_sync_info -> pdos[k].entries == NULL && source -> pdos[k].n_entries != 0)
+				return 1;
+
+			for(l = 0; l < source -> pdos[k].n_entries; l++)
+			{
+				ret = ecrt_master_get_pdo_entry(master, position, scan -> position[d], k, l,
+					&(target_sync_info -> pdos[k].entries[l]));
+				if(ret != 0)
+				{
+					printf("EtherCAT getting PDO entry structure failed!\n");
+					return ret;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void free_scan_list(igh_scan_t* scan_list, int count)
+{
+	int i;
+
+	for(i = 0; i < count; i++)
+	{
+		if(!scan_list[i].cached)
+		{
+			free(scan_list[i].sync[0].pdos);
+			free(scan_list[i].sync[1].pdos);
+		}
+	}
+	free(scan_list);
+}
+
+static void load_cache(void)
+{
+	int fd;
+	struct stat st;
+
+	if(cache_path[0] == '\0')
+		return;
+
+	fd = open(cache_path, O_RDONLY);
+	if(fd < 0)
+		return;
+
+	if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(igh_cache_header_t))
+	{
+		close(fd);
+		return;
+	}
+
+	cache = (igh_cache_header_t*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(cache == MAP_FAILED)
+	{
+		cache = NULL;
+		return;
+	}
+	cache_size = st.st_size;
+
+	/* the tables must exactly fill the file */
+	if(cache -> magic != IGH_CACHE_MAGIC || cache -> version != IGH_CACHE_VERSION ||
+		cache -> size != (uint32_t)st.st_size || cache -> slave_count != (uint32_t)slave_count ||
+		cache -> size != sizeof(igh_cache_header_t) + sizeof(igh_cache_slave_t) * (size_t)cache -> slave_count +
+			sizeof(igh_cache_pdo_t) * (size_t)cache -> pdo_count + sizeof(igh_cache_entry_t) * (size_t)cache -> entry_count)
+	{
+		munmap(cache, cache_size);
+		cache = NULL;
+	}
+}
+
+static int load_cached_slave(const ec_slave_info_t* info, int position,
+	ec_sync_info_t* input_sync_info, ec_sync_info_t* output_sync_info, int* entry_count)
+{
+	int d, k, l;
+	const igh_cache_slave_t* slave = (const igh_cache_slave_t*)(cache + 1) + position;
+	const igh_cache_pdo_t* pdo_list = (const igh_cache_pdo_t*)((const igh_cache_slave_t*)(cache + 1) + cache -> slave_count);
+	const igh_cache_entry_t* entry_list = (const igh_cache_entry_t*)(pdo_list + cache -> pdo_count);
+	const igh_cache_sync_t* sync;
+	const igh_cache_pdo_t* pdo;
+	ec_sync_info_t* sync_info;
+	ec_pdo_entry_info_t* entries;
+
+	if(slave -> vendor_id != info -> vendor_id || slave -> product_code != info -> product_code ||
+		slave -> revision_number != info -> revision_number)
+		return 1;
+
+	for(d = 0; d < 2; d++)
+	{
+		sync = &(slave -> sync[d]);
+		if((uint64_t)sync -> first_pdo + sync -> n_pdos > cache -> pdo_count)
+			return 1;
+		for(k = 0; k < sync -> n_pdos; k++)
+		{
+			pdo = &pdo_list[sync -> first_pdo + k];
+			if((uint64_t)pdo -> first_entry + pdo -> n_entries > cache -> entry_count)
+				return 1;
+		}
+	}
+
+	/* sync[0] holds the outputs, sync[1] the inputs */
+	for(d = 0; d < 2; d++)
+	{
+		sync = &(slave -> sync[d]);
+		sync_info = d ? input_sync_info : output_sync_info;
+		if(sync -> n_pdos == 0)
+			continue;
+
+		sync_info -> index = sync -> index;
+		sync_info -> dir = (ec_direction_t)sync -> dir;
+		sync_info -> n_pdos = sync -> n_pdos;
+		sync_info -> watchdog_mode = (ec_watchdog_mode_t)sync -> watchdog_mode;
+		sync_info -> pdos = (ec_pdo_info_t*)arena_alloc(&topology_arena, sizeof(ec_pdo_info_t) * sync -> n_pdos);
+
+		for(k = 0; k < sync -> n_pdos; k++)
+		{
+			pdo = &pdo_list[sync -> first_pdo + k];
+			*entry_count += pdo -> n_entries;
+			entries = (ec_pdo_entry_info_t*)arena_alloc(&topology_arena, sizeof(ec_pdo_entry_info_t) * pdo -> n_entries);
+
+			/* the counting pass only sizes the blocks */
+			if(topology_arena.base == NULL)
+				continue;
+			if(sync_info -> pdos == NULL || entries == NULL)
+				return 1;
+
+			sync_info -> pdos[k].index = pdo -> index;
+			sync_info -> pdos[k].n_entries = pdo -> n_entries;
+			sync_info -> pdos[k].entries = entries;
+			for(l = 0; l < pdo -> n_entries; l++)
+			{
+				entries[l].index = entry_list[pdo -> first_entry + l].index;
+				entries[l].subindex = entry_list[pdo -> first_entry + l].subindex;
+				entries[l].bit_length = entry_list[pdo -> first_entry + l].bit_length;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int save_cache(void)
+{
+	int i, d, k, l;
+	int fd, ret;
+	size_t size;
+	uint32_t pdo_count = 0;
+	uint32_t entry_count = 0;
+	char path[sizeof(cache_path) + 4];
+	char* memory;
+	igh_cache_header_t* cache;
+	igh_cache_slave_t* slave_list;
+	igh_cache_pdo_t* pdo_list;
+	igh_cache_entry_t* entry_list;
+	ec_sync_info_t* sync_info;
+
+	for(i = 0; i < slave_count; i++)
+	{
+		for(d = 0; d < 2; d++)
+		{
+			sync_info = d ? &input_sync_info_list[i] : &output_sync_info_list[i];
+			for(k = 0; sync_info -> pdos != NULL && k < sync_info -> n_pdos; k++)
+			{
+				pdo_count++;
+				entry_count += sync_info -> pdos[k].n_entries;
+			}
+		}
+	}
+
+	size = sizeof(igh_cache_header_t) + sizeof(igh_cache_slave_t) * slave_count +
+		sizeof(igh_cache_pdo_t) * pdo_count + sizeof(igh_cache_entry_t) * entry_count;
+	memory = (char*)calloc(1, size);
+	if(memory == NULL)
+		return 1;
+
+	cache = (igh_cache_header_t*)memory;
+	slave_list = (igh_cache_slave_t*)(cache + 1);
+	pdo_list = (igh_cache_pdo_t*)(slave_list + slave_count);
+	entry_list = (igh_cache_entry_t*)(pdo_list + pdo_count);
+
+	cache -> magic = IGH_CACHE_MAGIC;
+	cache -> version = IGH_CACHE_VERSION;
+	cache -> size = size;
+	cache -> slave_count = slave_count;
+	cache -> pdo_count = pdo_count;
+	cache -> entry_count = entry_count;
+
+	pdo_count = 0;
+	entry_count = 0;
+	for(i = 0; i < slave_count; i++)
+	{
+		slave_list[i].vendor_id = slave_info_list[i].vendor_id;
+		slave_list[i].product_code = slave_info_list[i].product_code;
+		slave_list[i].revision_number = slave_info_list[i].revision_number;
+
+		for(d = 0; d < 2; d++)
+		{
+			sync_info = d ? &input_sync_info_list[i] : &output_sync_info_list[i];
+			if(sync_info -> pdos == NULL)
+				continue;
+
+			slave_list[i].sync[d].index = sync_info -> index;
+			slave_list[i].sync[d].dir = sync_info -> dir;
+			slave_list[i].sync[d].watchdog_mode = sync_info -> watchdog_mode;
+			slave_list[i].sync[d].n_pdos = sync_info -> n_pdos;
+			slave_list[i].sync[d].first_pdo = pdo_count;
+
+			for(k = 0; k < sync_info -> n_pdos; k++, pdo_count++)
+			{
+				pdo_list[pdo_count].index = sync_info -> pdos[k].index;
+				pdo_list[pdo_count].n_entries = sync_info -> pdos[k].n_entries;
+				pdo_list[pdo_count].first_entry = entry_count;
+
+				for(l = 0; l < sync_info -> pdos[k].n_entries; l++, entry_count++)
+				{
+					entry_list[entry_count].index = sync_info -> pdos[k].entries[l].index;
+					entry_list[entry_count].subindex = sync_info -> pdos[k].entries[l].subindex;
+					entry_list[entry_count].bit_length = sync_info -> pdos[k].entries[l].bit_length;
+				}
+			}
+		}
+	}
+
+	/* replace the file atomically, a reader never sees a partial one */
+	snprintf(path, sizeof(path), "%s.tmp", cache_path);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0)
+	{
+		free(memory);
+		return 1;
+	}
+
+	ret = write(fd, memory, size) != (ssize_t)size;
+	ret |= close(fd) != 0;
+	free(memory);
+
+	if(ret != 0 || rename(path, cache_path) != 0)
+	{
+		unlink(path);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* the table is sized and allocated by igh_init() */
+static void build_entry_index(void)
+{
+	int i, j, k, direction;
+	unsigned long long key;
+	unsigned int mask, slot;
+	ec_sync_info_t* sync_info;
+
+	mask = (1U << entry_index_bits) - 1;
+
+	for(i = 0; i < slave_count; i++)
+	{
+		for(direction = 0; direction < 2; direction++)
+		{
+			sync_info = direction ? &input_sync_info_list[i] : &output_sync_info_list[i];
+			for(j = 0; sync_info -> pdos != NULL && j < sync_info -> n_pdos; j++)
+			{
+				if(sync_info -> pdos[j].entries == NULL)
+					continue;
+
+				for(k = 0; k < sync_info -> pdos[j].n_entries; k++)
+				{
+					key = entry_key(i, sync_info -> pdos[j].entries[k].index,
+						sync_info -> pdos[j].entries[k].subindex, direction);
+
+					/* the first of duplicated entries wins, as in a linear scan */
+					for(slot = entry_hash(key); entry_index[slot].key != 0 && entry_index[slot].key != key;
+						slot = (slot + 1) & mask)
+						;
+					if(entry_index[slot].key == key)
+						continue;
+
+					entry_index[slot].key = key;
+					entry_index[slot].bit_length = sync_info -> pdos[j].entries[k].bit_length;
+					entry_index[slot].domain = -1;
+				}
+			}
+		}
+	}
+}
+
+static unsigned long long entry_key(uint16_t slave, uint16_t index, uint8_t subindex, int direction)
+{
+	return IGH_ENTRY_KEY_VALID | (unsigned long long)slave << 32 | (unsigned long long)index << 16 |
+		(unsigned long long)subindex << 8 | (unsigned long long)direction;
+}
+
+/* Fibonacci hashing, the upper bits of the product are best mixed */
+static unsigned int entry_hash(unsigned long long key)
+{
+	return (unsigned int)((key * 0x9e3779b97f4a7c15ULL) >> (64 - entry_index_bits));
+}
+
+static void clear_inout_list()
+{
+	int i;
+
+	for(i = 0; i < domain_count; i++)
+	{
+		free_program(&(domain_list[i].input_program));
+		free_program(&(domain_list[i].output_program));
+		domain_list[i].entry_count = 0;
+	}
+	free_next_programs();
+
+	if(pdo_entry_reg != NULL)
+	{
+		free(pdo_entry_reg);
+		pdo_entry_reg = NULL;
+	}
+
+	if(input_list != NULL)
+	{
+		free(input_list);
+		input_list = NULL;
+		input_count = 0;
+	}
+
+	if(output_list != NULL)
+	{
+		free(output_list);
+		output_list = NULL;
+		output_count = 0;
+	}
+
+	if(direct_list != NULL)
+	{
+		free(direct_list);
+		direct_list = NULL;
+		direct_count = 0;
+	}
+}
+
+static int get_domain(int rate_group)
+{
+	int i;
+	unsigned int divider = rate_group > 1 ? rate_group : 1;
+
+	for(i = 0; i < domain_count; i++)
+	{
+		if(domain_list[i].divider == divider)
+			return i;
+	}
+
+	if(domain_count == IGH_MAX_DOMAINS)
+		return -1;
+
+	domain_list[domain_count].domain = ecrt_master_create_domain(master);
+	if(domain_list[domain_count].domain == NULL)
+		return -1;
+	domain_list[domain_count].divider = divider;
+
+	return domain_count++;
+}
+
+static int compile_program(igh_program_t* program, igh_value_t* value_list, int value_count, int domain)
+{
+	int i, j;
+	unsigned int length;
+	igh_value_t** sorted_list;
+	igh_value_t* value;
+	igh_value_t* next;
+	char* memory;
+
+	free_program(program);
+
+	if(value_count == 0)
+		return 0;
+
+	sorted_list = (igh_value_t**)malloc(sizeof(igh_value_t*) * value_count);
+	if(sorted_list == NULL)
+		return 1;
+
+	/* entries without variable are registered only */
+	for(i = 0, j = 0; i < value_count; i++)
 	{
-		if(temp_sync_info -> pdos[i].entries == NULL)
+		if(value_list[i].domain == domain && value_list[i].variable != NULL)
+			sorted_list[j++] = &value_list[i];
+	}
+	value_count = j;
+	if(value_count == 0)
+	{
+		free(sorted_list);
+		return 0;
+	}
+	qsort(sorted_list, value_count, sizeof(igh_value_t*), compare_value);
+
+	/* every list is sized for the worst case and carved from one block */
+	memory = (char*)malloc((sizeof(igh_block_op_t) + sizeof(igh_word_op_t) * 3 +
+		sizeof(igh_bit_op_t) + sizeof(igh_bit_group_t)) * value_count);
+	if(memory == NULL)
+	{
+		free(sorted_list);
+		return 1;
+	}
+
+	program -> memory = memory;
+	program -> block_list = (igh_block_op_t*)memory;
+	program -> u8_list = (igh_word_op_t*)(program -> block_list + value_count);
+	program -> u16_list = program -> u8_list + value_count;
+	program -> u32_list = program -> u16_list + value_count;
+	program -> bit_list = (igh_bit_op_t*)(program -> u32_list + value_count);
+	program -> group_list = (igh_bit_group_t*)(program -> bit_list + value_count);
+
+	for(i = 0; i < value_count; i = j)
+	{
+		value = sorted_list[i];
+		j = i + 1;
+
+		if(value -> bit_length == 1)
+		{
+			if(program -> group_count == 0 ||
+				program -> group_list[program -> group_count - 1].offset != value -> offset)
+			{
+				program -> group_list[program -> group_count].offset = value -> offset;
+				program -> group_list[program -> group_count].first = program -> bit_count;
+				program -> group_list[program -> group_count].count = 0;
+				program -> group_count++;
+			}
+
+			program -> bit_list[program -> bit_count].variable = (uint8_t*)value -> variable;
+			program -> bit_list[program -> bit_count].mask = (uint8_t)(1 << value -> bit_pos);
+			program -> bit_count++;
+			program -> group_list[program -> group_count - 1].count++;
 			continue;
+		}
+
+		/* entries of other widths are not exchanged */
+		if(value -> bit_length != 8 && value -> bit_length != 16 && value -> bit_length != 32)
+			continue;
+
+		length = value -> bit_length / 8;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		/* domain and model are both little endian, merge adjacent entries */
+		while(j < value_count)
+		{
+			next = sorted_list[j];
+			if(next -> bit_length != 8 && next -> bit_length != 16 && next -> bit_length != 32)
+				break;
+			if(next -> bit_pos != 0 || next -> offset != value -> offset + length ||
+				(uint8_t*)next -> variable != (uint8_t*)value -> variable + length)
+				break;
 
-		for(j = 0; j < temp_sync_info -> pdos[i].n_entries; j++)
+			length += next -> bit_length / 8;
+			j++;
+		}
+
+		if(j - i > 1)
+		{
+			program -> block_list[program -> block_count].variable = (uint8_t*)value -> variable;
+			program -> block_list[program -> block_count].offset = value -> offset;
+			program -> block_list[program -> block_count].length = length;
+			program -> block_count++;
+			continue;
+		}
+#else
+		(void)next;
+#endif
+
+		switch(value -> bit_length)
 		{
-			if(index == temp_sync_info -> pdos[i].entries[j].index &&
-				subindex == temp_sync_info -> pdos[i].entries[j].subindex)
-				return temp_sync_info -> pdos[i].entries[j].bit_length;
+			case 8 :
+				program -> u8_list[program -> u8_count].variable = value -> variable;
+				program -> u8_list[program -> u8_count].offset = value -> offset;
+				program -> u8_count++;
+				break;
+			case 16 :
+				program -> u16_list[program -> u16_count].variable = value -> variable;
+				program -> u16_list[program -> u16_count].offset = value -> offset;
+				program -> u16_count++;
+				break;
+			case 32 :
+				program -> u32_list[program -> u32_count].variable = value -> variable;
+				program -> u32_list[program -> u32_count].offset = value -> offset;
+				program -> u32_count++;
+				break;
 		}
 	}
 
+	free(sorted_list);
+
+	return 0;
+}
+
+/* seqlock write of all domains, stamped with an application time the cycle already has */
+static void publish_image(void)
+{
+	int i;
+	uint8_t* data = image_data(&image);
+	unsigned long long time = 0;
+
+	/* sync_dc() consumed io_dc_sync() for this send */
+	if(dc_active)
+		time = dc_last_app_time;
+	else if(dc_time_set)
+		time = dc_app_time;
+	else
+		time = image_time();
+
+	image_begin(&image);
+	for(i = 0; i < domain_count; i++)
+	{
+		if(domain_list[i].size != 0)
+			memcpy(data + domain_list[i].image_offset, domain_list[i].pd, domain_list[i].size);
+	}
+	image_end(&image, exchange_cycle, time);
+}
+
+/* monotonic time in ns read without a system call, which would switch
+	a Xenomai task to secondary mode */
+static unsigned long long image_time(void)
+{
+#ifdef __XENO__
+	return rt_timer_tsc2ns(rt_timer_tsc());
+#else
+	/* the simulator runs on a host with a vDSO clock */
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+static int compare_image_entry(const void* a, const void* b)
+{
+	const image_entry_t* entry_a = (const image_entry_t*)a;
+	const image_entry_t* entry_b = (const image_entry_t*)b;
+
+	if(entry_a -> offset != entry_b -> offset)
+		return entry_a -> offset < entry_b -> offset ? -1 : 1;
+
+	return (int)entry_a -> bit_pos - (int)entry_b -> bit_pos;
+}
+
+static void record_registration(const igh_value_t* value_list, int value_count)
+{
+	int i;
+
+	for(i = 0; i < value_count; i++)
+	{
+		value_list[i].entry -> domain = value_list[i].domain;
+		value_list[i].entry -> offset = value_list[i].offset;
+		value_list[i].entry -> bit_pos = value_list[i].bit_pos;
+	}
+}
+
+static void swap_programs(void)
+{
+	int i;
+	igh_program_t temp;
+
+	for(i = 0; i < domain_count; i++)
+	{
+		temp = domain_list[i].input_program;
+		domain_list[i].input_program = domain_list[i].next_input_program;
+		domain_list[i].next_input_program = temp;
+
+		temp = domain_list[i].output_program;
+		domain_list[i].output_program = domain_list[i].next_output_program;
+		domain_list[i].next_output_program = temp;
+	}
+}
+
+static void free_next_programs(void)
+{
+	int i;
+
+	for(i = 0; i < domain_count; i++)
+	{
+		free_program(&(domain_list[i].next_input_program));
+		free_program(&(domain_list[i].next_output_program));
+	}
+}
+
+static void free_program(igh_program_t* program)
+{
+	if(program -> memory != NULL)
+		free(program -> memory);
+
+	memset(program, 0, sizeof(igh_program_t));
+}
+
+static int compare_value(const void* a, const void* b)
+{
+	const igh_value_t* value_a = *(const igh_value_t**)a;
+	const igh_value_t* value_b = *(const igh_value_t**)b;
+
+	if(value_a -> offset != value_b -> offset)
+		return value_a -> offset < value_b -> offset ? -1 : 1;
+	if(value_a -> bit_pos != value_b -> bit_pos)
+		return value_a -> bit_pos < value_b -> bit_pos ? -1 : 1;
+
+	/* keep mapping order of entries sharing the same object */
+	if(value_a != value_b)
+		return value_a < value_b ? -1 : 1;
+
 	return 0;
 }
 
-static void free_sync_info_list(ec_sync_info_t* sync_info_list)
+static void write_program(const igh_program_t* program, uint8_t* pd)
+{
+	int i, j;
+	const igh_bit_group_t* group;
+	uint8_t byte;
+
+	for(i = 0; i < program -> block_count; i++)
+		memcpy(pd + program -> block_list[i].offset, program -> block_list[i].variable, program -> block_list[i].length);
+
+	for(i = 0; i < program -> u8_count; i++)
+		EC_WRITE_U8(pd + program -> u8_list[i].offset, *((uint8_t*)program -> u8_list[i].variable));
+
+	for(i = 0; i < program -> u16_count; i++)
+		EC_WRITE_U16(pd + program -> u16_list[i].offset, *((uint16_t*)program -> u16_list[i].variable));
+
+	for(i = 0; i < program -> u32_count; i++)
+		EC_WRITE_U32(pd + program -> u32_list[i].offset, *((uint32_t*)program -> u32_list[i].variable));
+
+	/* patch every domain byte once for all of its bits */
+	for(i = 0; i < program -> group_count; i++)
+	{
+		group = &(program -> group_list[i]);
+		byte = pd[group -> offset];
+		for(j = group -> first; j < group -> first + group -> count; j++)
+		{
+			byte &= ~(program -> bit_list[j].mask);
+			if(*(program -> bit_list[j].variable))
+				byte |= program -> bit_list[j].mask;
+		}
+		pd[group -> offset] = byte;
+	}
+}
+
+static void read_program(const igh_program_t* program, const uint8_t* pd)
 {
 	int i, j;
+	const igh_bit_group_t* group;
+	uint8_t byte;
+
+	for(i = 0; i < program -> block_count; i++)
+		memcpy(program -> block_list[i].variable, pd + program -> block_list[i].offset, program -> block_list[i].length);
+
+	for(i = 0; i < program -> u8_count; i++)
+		*((uint8_t*)program -> u8_list[i].variable) = EC_READ_U8(pd + program -> u8_list[i].offset);
+
+	for(i = 0; i < program -> u16_count; i++)
+		*((uint16_t*)program -> u16_list[i].variable) = EC_READ_U16(pd + program -> u16_list[i].offset);
+
+	for(i = 0; i < program -> u32_count; i++)
+		*((uint32_t*)program -> u32_list[i].variable) = EC_READ_U32(pd + program -> u32_list[i].offset);
+
+	for(i = 0; i < program -> group_count; i++)
+	{
+		group = &(program -> group_list[i]);
+		byte = pd[group -> offset];
+		for(j = group -> first; j < group -> first + group -> count; j++)
+			*(program -> bit_list[j].variable) = (byte & program -> bit_list[j].mask) != 0;
+	}
+}
+
+static int configure_dc(unsigned long long interval)
+{
+	int i, ret;
+	ec_slave_config_t* reference = NULL;
+
+	dc_active = 0;
+	memset(&dc_stat, 0, sizeof(dc_stat));
+	if(dc_mode == IO_DC_OFF)
+		return 0;
+
+	for(i = 0; i < slave_count; i++)
+	{
+		if(dc_slave_list[i].dc_assign_activate == 0)
+			continue;
+
+		ecrt_slave_config_dc(dc_slave_list[i].config_p, dc_slave_list[i].dc_assign_activate,
+			interval, dc_shift, 0, 0);
+		if(reference == NULL)
+			reference = dc_slave_list[i].config_p;
+	}
+
+	if(reference == NULL)
+	{
+		printf("EtherCAT no slave with distributed clocks found!\n");
+		return 1;
+	}
+
+	/* the first synchronised slave is the reference clock */
+	ret = ecrt_master_select_reference_clock(master, reference);
+	if(ret != 0)
+	{
+		printf("EtherCAT selecting reference clock failed!\n");
+		return -ret;
+	}
+
+	dc_interval = interval;
+	dc_last_app_time = 0;
+	dc_active = 1;
+
+	return 0;
+}
+
+static void sync_dc(void)
+{
+	/* without io_dc_sync() the application time advances nominally */
+	if(!dc_time_set)
+		dc_app_time += dc_interval;
+	dc_time_set = 0;
+
+	ecrt_master_application_time(master, dc_app_time);
+	if(dc_mode == IO_DC_BUS_SHIFT)
+		ecrt_master_sync_reference_clock(master);
+	ecrt_master_sync_slave_clocks(master);
+
+	dc_last_app_time = dc_app_time;
+}
+
+static void measure_dc(void)
+{
+	uint32_t reference_time;
+	long long offset;
+
+	if(dc_last_app_time == 0 || ecrt_master_reference_clock_time(master, &reference_time) != 0)
+		return;
+
+	/* only the lower 32 bits are available, enough for offsets below 2 s */
+	offset = (int32_t)(reference_time - (uint32_t)dc_last_app_time);
+
+	if(dc_stat.count == 0 || offset < dc_stat.min_offset)
+		dc_stat.min_offset = offset;
+	if(dc_stat.count == 0 || offset > dc_stat.max_offset)
+		dc_stat.max_offset = offset;
+	dc_stat.offset = offset;
+	dc_stat.count++;
+}
+
+/* working counters of the domains due, then one master or slave state */
+static void monitor_bus(unsigned int due)
+{
+	int i;
+	int period;
+	uint8_t state, last_state;
+	ec_domain_state_t domain_state;
+	ec_master_state_t master_state;
+	ec_slave_config_state_t config_state;
+
+	__atomic_store_n(&status_sequence, status_sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
 
-	if(sync_info_list != NULL)
+	status.cycle = exchange_cycle;
+	for(i = 0; i < domain_count; i++)
 	{
-		for(i = 0; i < slave_count; i++)
+		if(!(due & (1 << i)))
+			continue;
+
+		ecrt_domain_state(domain_list[i].domain, &domain_state);
+		if(domain_state.wc_state != EC_WC_COMPLETE)
+			status.wc_fault_count++;
+		if((int)domain_state.wc_state != status.wc_state[i])
+			status.wc_change_count++;
+		status.working_counter[i] = domain_state.working_counter;
+		status.wc_state[i] = domain_state.wc_state;
+	}
+
+	period = __atomic_load_n(&monitor_period, __ATOMIC_RELAXED);
+	if(period != 0 && --monitor_countdown <= 0)
+	{
+		monitor_countdown = period;
+
+		if(monitor_next < 0)
+		{
+			ecrt_master_state(master, &master_state);
+			if(status.link_up >= 0)
+			{
+				if((int)master_state.link_up != status.link_up)
+					status.link_change_count++;
+				if((int)master_state.slaves_responding != status.slaves_responding)
+					status.responding_change_count++;
+			}
+			status.link_up = master_state.link_up;
+			status.slaves_responding = master_state.slaves_responding;
+			status.al_states = master_state.al_states;
+		}
+		else
 		{
-			if(sync_info_list[i].pdos != NULL)
+			ecrt_slave_config_state(bus_slave_list[monitor_next].config_p, &config_state);
+			state = 0;
+			if(config_state.online)
+				state = config_state.al_state | (config_state.operational ? IGH_SLAVE_STATE_OP : 0);
+
+			last_state = slave_state_list[monitor_next];
+			if(state != last_state)
 			{
-				for(j = 0; j < sync_info_list[i].n_pdos; j++)
+				if(last_state == IGH_SLAVE_STATE_UNKNOWN)
+					last_state = 0;
+				else
+				{
+					status.al_change_count++;
+					status.last_slave = monitor_next;
+					status.last_al_state = state & 0x0f;
+				}
+
+				if((last_state & IGH_SLAVE_STATE_OP) && !(state & IGH_SLAVE_STATE_OP))
 				{
-					if(sync_info_list[i].pdos[j].entries != NULL)
-					{
-						free(sync_info_list[i].pdos[j].entries);
-					}
+					status.op_lost_count++;
+					status.operational_count--;
 				}
-				free(sync_info_list[i].pdos);
+				else if(!(last_state & IGH_SLAVE_STATE_OP) && (state & IGH_SLAVE_STATE_OP))
+					status.operational_count++;
+				slave_state_list[monitor_next] = state;
 			}
 		}
-		free(sync_info_list);
+
+		if(++monitor_next >= slave_count)
+			monitor_next = -1;
 	}
+
+	__atomic_store_n(&status_sequence, status_sequence + 1, __ATOMIC_RELEASE);
 }
 
-static void clear_inout_list()
+/* PDOs of the flexible slaves reduced to the mapped entries, before registration */
+static int optimize_pdos(const io_mapping_info_t* mapping_list, int mapping_count)
 {
-	if(pdo_entry_reg != NULL)
+	int i, d, n, ret;
+	int flexible = 0;
+	unsigned long long* key_list;
+	ec_sync_info_t sync_list[2];
+
+	memset(&pdo_report, 0, sizeof(io_pdo_report_t));
+	for(i = 0; i < slave_count; i++)
+		flexible += pdo_flexible_list[i];
+	if(flexible == 0)
+		return 0;
+
+	/* the PDOs of a slave cannot change once its entries are in a domain */
+	if(pdo_registered)
 	{
-		free(pdo_entry_reg);
-		pdo_entry_reg = NULL;
+		printf("EtherCAT PDOs are only optimized on the first mapping!\n");
+		return 0;
 	}
 
-	if(input_list != NULL)
+	key_list = (unsigned long long*)malloc(sizeof(unsigned long long) * (mapping_count + 1));
+	if(key_list == NULL)
+		return 1;
+	for(i = 0; i < mapping_count; i++)
 	{
-		free(input_list);
-		input_list = NULL;
-		input_count = 0;
+		key_list[i] = entry_key(pdo_entry_reg[i].position, pdo_entry_reg[i].index, pdo_entry_reg[i].subindex,
+			mapping_list[i].direction);
 	}
+	qsort(key_list, mapping_count, sizeof(unsigned long long), compare_key);
 
-	if(output_list != NULL)
+	for(i = 0; i < slave_count; i++)
 	{
-		free(output_list);
-		output_list = NULL;
-		output_count = 0;
+		if(!pdo_flexible_list[i])
+			continue;
+
+		n = 0;
+		for(d = 0; d < 2; d++)
+		{
+			ret = build_sync(&sync_list[n], d ? &input_sync_info_list[i] : &output_sync_info_list[i], i, d,
+				key_list, mapping_count);
+			if(ret < 0)
+				break;
+			n += ret != 0;
+		}
+
+		ret = ret < 0 ? 1 : n != 0 ? ecrt_slave_config_pdos(bus_slave_list[i].config_p, n, sync_list) : 0;
+		for(d = 0; d < n; d++)
+		{
+			free(sync_list[d].pdos[0].entries);
+			free(sync_list[d].pdos);
+		}
+		if(ret != 0)
+		{
+			printf("EtherCAT configuring PDOs of slave %d failed!\n", i);
+			free(key_list);
+			return 1;
+		}
+		pdo_report.slave_count += n != 0;
+	}
+	free(key_list);
+
+	return 0;
+}
+
+/* keeps the mapped entries of source, returns their count or -1
+
+	Entries of 8 bits or more stay byte aligned and every PDO ends on a
+	byte, with gaps where needed. PDOs left empty are not assigned.
+*/
+static int build_sync(ec_sync_info_t* sync, const ec_sync_info_t* source, int slave, int direction,
+	const unsigned long long* key_list, int key_count)
+{
+	int j, k;
+	int entry_count = 0;
+	int kept = 0;
+	unsigned int bits;
+	unsigned long long key;
+	ec_pdo_info_t* pdo;
+	ec_pdo_entry_info_t* entry;
+	ec_pdo_entry_info_t* entry_list;
+
+	memset(sync, 0, sizeof(ec_sync_info_t));
+	for(j = 0; source -> pdos != NULL && j < source -> n_pdos; j++)
+		entry_count += source -> pdos[j].n_entries;
+	if(entry_count == 0)
+		return 0;
+
+	sync -> pdos = (ec_pdo_info_t*)malloc(sizeof(ec_pdo_info_t) * source -> n_pdos);
+	entry_list = (ec_pdo_entry_info_t*)malloc(sizeof(ec_pdo_entry_info_t) * (entry_count * 2 + source -> n_pdos));
+	if(sync -> pdos == NULL || entry_list == NULL)
+	{
+		free(sync -> pdos);
+		free(entry_list);
+		return -1;
+	}
+
+	/* the entries of all PDOs are kept in one block, freed through the first PDO */
+	entry = entry_list;
+	for(j = 0; j < source -> n_pdos; j++)
+	{
+		pdo = &(sync -> pdos[sync -> n_pdos]);
+		pdo -> index = source -> pdos[j].index;
+		pdo -> n_entries = 0;
+		pdo -> entries = entry;
+
+		bits = 0;
+		for(k = 0; k < source -> pdos[j].n_entries; k++)
+		{
+			key = entry_key(slave, source -> pdos[j].entries[k].index, source -> pdos[j].entries[k].subindex, direction);
+			if(source -> pdos[j].entries[k].index == 0 ||
+				bsearch(&key, key_list, key_count, sizeof(unsigned long long), compare_key) == NULL)
+				continue;
+
+			if(source -> pdos[j].entries[k].bit_length >= 8 && bits % 8 != 0)
+			{
+				entry -> index = 0;
+				entry -> subindex = 0;
+				entry -> bit_length = 8 - bits % 8;
+				bits += (entry++) -> bit_length;
+				pdo -> n_entries++;
+			}
+			*entry = source -> pdos[j].entries[k];
+			bits += (entry++) -> bit_length;
+			pdo -> n_entries++;
+			kept++;
+		}
+		if(pdo -> n_entries == 0)
+			continue;
+
+		if(bits % 8 != 0)
+		{
+			entry -> index = 0;
+			entry -> subindex = 0;
+			entry -> bit_length = 8 - bits % 8;
+			entry++;
+			pdo -> n_entries++;
+		}
+		sync -> n_pdos++;
+	}
+
+	if(kept == 0)
+	{
+		free(sync -> pdos);
+		free(entry_list);
+		memset(sync, 0, sizeof(ec_sync_info_t));
+		return 0;
+	}
+
+	sync -> index = source -> index;
+	sync -> dir = source -> dir;
+	sync -> watchdog_mode = source -> watchdog_mode;
+
+	return kept;
+}
+
+/* bytes per frame with the reported and with the configured PDOs */
+static void report_frame(const io_mapping_info_t* mapping_list, int mapping_count)
+{
+	int i, d;
+	uint8_t* used;
+
+	pdo_report.reported_size = 0;
+	pdo_report.size = 0;
+	for(d = 0; d < domain_count; d++)
+		pdo_report.size += ecrt_domain_size(domain_list[d].domain);
+
+	/* a domain holds the whole sync manager of every registered entry */
+	used = (uint8_t*)calloc(slave_count + 1, 1);
+	if(used == NULL)
+		return;
+	for(i = 0; i < mapping_count; i++)
+		used[pdo_entry_reg[i].position] |= 1 << (mapping_list[i].direction != 0);
+
+	for(i = 0; i < slave_count; i++)
+	{
+		if(used[i] & 1)
+			pdo_report.reported_size += (sync_bit_length(&output_sync_info_list[i]) + 7) / 8;
+		if(used[i] & 2)
+			pdo_report.reported_size += (sync_bit_length(&input_sync_info_list[i]) + 7) / 8;
+	}
+	free(used);
+}
+
+static unsigned int sync_bit_length(const ec_sync_info_t* sync)
+{
+	int j, k;
+	unsigned int bits = 0;
+
+	for(j = 0; sync -> pdos != NULL && j < sync -> n_pdos; j++)
+	{
+		for(k = 0; sync -> pdos[j].entries != NULL && k < sync -> pdos[j].n_entries; k++)
+			bits += sync -> pdos[j].entries[k].bit_length;
 	}
+
+	return bits;
+}
+
+static int compare_key(const void* a, const void* b)
+{
+	unsigned long long key_a = *(const unsigned long long*)a;
+	unsigned long long key_b = *(const unsigned long long*)b;
+
+	return key_a < key_b ? -1 : key_a > key_b;
 }
@@ -7,16 +7,33 @@
 typedef struct
 {
 	int position;
+	ec_slave_config_t* config_p;
+	unsigned int dc_assign_activate;
 
 	ec_slave_info_t* info_p;
 	ec_sync_info_t* input_sync_info_p;
 	ec_sync_info_t* output_sync_info_p;
 } igh_slave_t;
 
+int igh_set_topology_cache(const char* path);
 int igh_init(igh_slave_t** slave_list, int* slave_num);
+int igh_pdo_optimize(const int* position_list, int position_count);
 int igh_mapping(io_mapping_info_t* mapping_list, int mapping_count);
+int igh_mapping_report(io_mapping_report_t* report);
+int igh_pdo_report(io_pdo_report_t* report);
+int igh_remap(io_mapping_info_t* mapping_list, int mapping_count);
 int igh_activate(unsigned long long interval);
 int igh_exchange(void);
+int igh_receive(void);
+int igh_send(void);
+int igh_publish_image(const char* name);
+int igh_record_start(const char* path, const io_addr_t* addr_list, int addr_count, int depth);
+int igh_record_stop(void);
+int igh_monitor(int period);
+int igh_status(io_status_t* status);
+int igh_dc_configure(int mode, int shift);
+long long igh_dc_sync(unsigned long long app_time);
+int igh_dc_stat(io_dc_stat_t* stat);
 int igh_cleanup(igh_slave_t** slave_list);
 
 #endif
@@ -1,14 +1,27 @@
 #include "io.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "ecrt.h"
 #include "igh.h"
 #include "cia402.h"
+#include "prof.h"
+#include "sdo.h"
 
 static igh_slave_t* slave_list = NULL;
 static int slave_count = 0;
 
-static cia402_node_t* cia402_node_list = NULL;
-static int cia402_node_count = 0;
+static cia402_table_t cia402_table;
+
+/* entries io_mapping() added for the CiA402 nodes, kept across io_remap() */
+static io_mapping_info_t* node_mapping_list = NULL;
+static int node_mapping_count = 0;
+
+int io_topology_cache(const char* path)
+{
+	return igh_set_topology_cache(path);
+}
 
 int io_init(void)
 {
@@ -18,30 +31,82 @@ int io_init(void)
 	if(ret != 0)
 		return ret;
 
-	ret = cia402_get_node_list(slave_list, slave_count, &cia402_node_list, &cia402_node_count);
+	ret = cia402_get_node_table(slave_list, slave_count, &cia402_table);
 	if(ret != 0)
 		return ret;
 
 	return 0;
 }
 
+int io_pdo_optimize(const int* position_list, int position_count)
+{
+	return igh_pdo_optimize(position_list, position_count);
+}
+
 int io_mapping(io_mapping_info_t* mapping_list, int mapping_count)
 {
+	int i;
 	int ret = 0;
 	io_mapping_info_t* cia402_mapping_list;
 	int cia402_mapping_count = 0;
 
-	ret = cia402_get_mapping_list(cia402_node_list, cia402_node_count, mapping_list, mapping_count,
+	ret = cia402_get_mapping_list(&cia402_table, mapping_list, mapping_count,
 		&cia402_mapping_list, &cia402_mapping_count);
 	if(ret != 0)
 		return ret;
 
 	ret = igh_mapping(cia402_mapping_list, cia402_mapping_count);
+	if(ret != 0)
+	{
+		cia402_free_mapping_list(&cia402_mapping_list);
+		return ret;
+	}
+
+	free(node_mapping_list);
+	node_mapping_list = (io_mapping_info_t*)malloc(sizeof(io_mapping_info_t) * (cia402_mapping_count + 1));
+	node_mapping_count = 0;
+	for(i = 0; node_mapping_list != NULL && i < cia402_mapping_count; i++)
+	{
+		if(cia402_is_table_variable(&cia402_table, cia402_mapping_list[i].model_addr))
+			node_mapping_list[node_mapping_count++] = cia402_mapping_list[i];
+	}
 	cia402_free_mapping_list(&cia402_mapping_list);
 
+	return node_mapping_list == NULL;
+}
+
+int io_pdo_report(io_pdo_report_t* report)
+{
+	return igh_pdo_report(report);
+}
+
+int io_remap(io_mapping_info_t* mapping_list, int mapping_count)
+{
+	int ret;
+	io_mapping_info_t* remap_list;
+
+	if(node_mapping_list == NULL)
+		return 1;
+
+	/* the CiA402 node entries stay bound, the objects are replaced */
+	remap_list = (io_mapping_info_t*)malloc(sizeof(io_mapping_info_t) * (node_mapping_count + mapping_count + 1));
+	if(remap_list == NULL)
+		return 1;
+
+	memcpy(remap_list, node_mapping_list, sizeof(io_mapping_info_t) * node_mapping_count);
+	memcpy(remap_list + node_mapping_count, mapping_list, sizeof(io_mapping_info_t) * mapping_count);
+
+	ret = igh_remap(remap_list, node_mapping_count + mapping_count);
+	free(remap_list);
+
 	return ret;
 }
 
+int io_mapping_report(io_mapping_report_t* report)
+{
+	return igh_mapping_report(report);
+}
+
 int io_activate(unsigned long long interval)
 {
 	return igh_activate(interval);
@@ -50,20 +115,100 @@ int io_activate(unsigned long long interval)
 int io_exchange(void)
 {
 	int ret;
+	PROF_START(total);
 
-	cia402_publish(cia402_node_list, cia402_node_count);
+	ret = io_receive();
+	if(ret != 0)
+		return ret;
 
-	ret = igh_exchange();
+	ret = io_send();
+	PROF_MARK(total, PROF_EXCHANGE);
+
+	return ret;
+}
+
+int io_receive(void)
+{
+	int ret;
+
+	ret = igh_receive();
 	if(ret != 0)
 		return ret;
 
-	cia402_retrieve(cia402_node_list, cia402_node_count);
+	PROF_START(tick);
+	cia402_retrieve(&cia402_table);
+	PROF_MARK(tick, PROF_RETRIEVE);
+	sdo_service();
+	PROF_MARK(tick, PROF_SDO);
 
 	return 0;
 }
 
+int io_send(void)
+{
+	PROF_START(tick);
+	cia402_publish(&cia402_table);
+	PROF_MARK(tick, PROF_PUBLISH);
+
+	return igh_send();
+}
+
+int io_publish_image(const char* name)
+{
+	return igh_publish_image(name);
+}
+
+int io_record_start(const char* path, const io_addr_t* addr_list, int addr_count, int depth)
+{
+	return igh_record_start(path, addr_list, addr_count, depth);
+}
+
+int io_record_stop(void)
+{
+	return igh_record_stop();
+}
+
+int io_monitor(int period)
+{
+	return igh_monitor(period);
+}
+
+int io_status(io_status_t* status)
+{
+	return igh_status(status);
+}
+
+int io_sdo_submit(io_sdo_t* sdo)
+{
+	return cia402_sdo_submit(&cia402_table, sdo);
+}
+
+int io_sdo_complete(io_sdo_t** sdo)
+{
+	return sdo_complete(sdo);
+}
+
+int io_dc_configure(int mode, int shift)
+{
+	return igh_dc_configure(mode, shift);
+}
+
+long long io_dc_sync(unsigned long long app_time)
+{
+	return igh_dc_sync(app_time);
+}
+
+int io_dc_stat(io_dc_stat_t* stat)
+{
+	return igh_dc_stat(stat);
+}
+
 int io_cleanup(void)
 {
-	cia402_free_node_list(&cia402_node_list);
+	free(node_mapping_list);
+	node_mapping_list = NULL;
+	node_mapping_count = 0;
+
+	cia402_free_node_table(&cia402_table);
 	return igh_cleanup(&slave_list);
 }
@@ -0,0 +1,151 @@
+#include "image.h"
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* a reader gives up when the writer kept overtaking it */
+#define IMAGE_READ_RETRY 1000
+
+int image_create(image_t* image, const char* name, int entry_count, size_t data_size)
+{
+	int fd;
+	size_t entry_offset = (sizeof(image_header_t) + 7) & ~(size_t)7;
+	size_t data_offset = (entry_offset + sizeof(image_entry_t) * entry_count + 63) & ~(size_t)63;
+	size_t size = data_offset + data_size;
+
+	memset(image, 0, sizeof(image_t));
+	if(strlen(name) >= sizeof(image -> name))
+		return 1;
+
+	fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if(fd < 0)
+		return 1;
+
+	if(ftruncate(fd, size) != 0)
+	{
+		close(fd);
+		shm_unlink(name);
+		return 1;
+	}
+
+	image -> header = (image_header_t*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(image -> header == MAP_FAILED)
+	{
+		image -> header = NULL;
+		shm_unlink(name);
+		return 1;
+	}
+
+	/* touch every page now, the cycle must not fault */
+	memset(image -> header, 0, size);
+	image -> size = size;
+	image -> owner = 1;
+	strcpy(image -> name, name);
+
+	image -> header -> version = IMAGE_VERSION;
+	image -> header -> size = size;
+	image -> header -> entry_count = entry_count;
+	image -> header -> entry_offset = entry_offset;
+	image -> header -> data_size = data_size;
+	image -> header -> data_offset = data_offset;
+
+	return 0;
+}
+
+void image_ready(image_t* image)
+{
+	/* readers check the magic last */
+	__atomic_store_n(&(image -> header -> magic), IMAGE_MAGIC, __ATOMIC_RELEASE);
+}
+
+void image_begin(image_t* image)
+{
+	uint32_t sequence = image -> header -> sequence;
+
+	__atomic_store_n(&(image -> header -> sequence), sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void image_end(image_t* image, unsigned long long cycle, unsigned long long time)
+{
+	image -> header -> cycle = cycle;
+	image -> header -> time = time;
+	__atomic_store_n(&(image -> header -> sequence), image -> header -> sequence + 1, __ATOMIC_RELEASE);
+}
+
+int image_open(image_t* image, const char* name)
+{
+	int fd;
+	struct stat st;
+
+	memset(image, 0, sizeof(image_t));
+	if(strlen(name) >= sizeof(image -> name))
+		return 1;
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if(fd < 0)
+		return 1;
+
+	if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(image_header_t))
+	{
+		close(fd);
+		return 1;
+	}
+
+	image -> header = (image_header_t*)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(image -> header == MAP_FAILED)
+	{
+		image -> header = NULL;
+		return 1;
+	}
+	image -> size = st.st_size;
+	strcpy(image -> name, name);
+
+	if(__atomic_load_n(&(image -> header -> magic), __ATOMIC_ACQUIRE) != IMAGE_MAGIC ||
+		image -> header -> version != IMAGE_VERSION || image -> header -> size != image -> size)
+	{
+		image_close(image);
+		return 1;
+	}
+
+	return 0;
+}
+
+int image_read(const image_t* image, void* data, unsigned long long* cycle, unsigned long long* time)
+{
+	int i;
+	uint32_t sequence;
+	const image_header_t* header = image -> header;
+
+	for(i = 0; i < IMAGE_READ_RETRY; i++)
+	{
+		sequence = __atomic_load_n(&(header -> sequence), __ATOMIC_ACQUIRE);
+		if(sequence & 1)
+			continue;
+
+		memcpy(data, image_data(image), header -> data_size);
+		*cycle = header -> cycle;
+		*time = header -> time;
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&(header -> sequence), __ATOMIC_RELAXED) == sequence)
+			return 0;
+	}
+
+	return 1;
+}
+
+void image_close(image_t* image)
+{
+	if(image -> header != NULL)
+		munmap(image -> header, image -> size);
+	if(image -> owner)
+		shm_unlink(image -> name);
+
+	memset(image, 0, sizeof(image_t));
+}
@@ -0,0 +1,77 @@
+#ifndef _IMAGE_H
+#define _IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* shared-memory process image
+
+	The cycle copies the process data of all domains into a POSIX shared
+	memory segment after every send, guarded by a sequence counter : it is
+	odd while a copy is in progress and advances by two per snapshot. The
+	writer never waits and makes no system call; readers copy the data and
+	retry when the counter moved meanwhile. Besides the data the segment
+	holds a directory of the registered PDO entries, sorted by location,
+	whose offsets point into the data. Multi-byte entries are little
+	endian as on the bus. Readers only need this file and image.c.
+*/
+#define IMAGE_MAGIC 0x494d4147
+#define IMAGE_VERSION 1
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	uint32_t entry_count;
+	uint32_t entry_offset;
+	uint32_t data_size;
+	uint32_t data_offset;
+	uint32_t sequence;
+	uint64_t cycle;
+	uint64_t time;
+} image_header_t;
+
+typedef struct
+{
+	uint16_t slave;
+	uint16_t index;
+	uint8_t subindex;
+	uint8_t direction;
+	uint8_t bit_pos;
+	uint8_t bit_length;
+	uint32_t offset;
+} image_entry_t;
+
+typedef struct
+{
+	image_header_t* header;
+	size_t size;
+	int owner;
+	char name[64];
+} image_t;
+
+/* writer, the segment opens to readers once the directory is filled */
+int image_create(image_t* image, const char* name, int entry_count, size_t data_size);
+void image_ready(image_t* image);
+void image_begin(image_t* image);
+void image_end(image_t* image, unsigned long long cycle, unsigned long long time);
+
+/* readers */
+int image_open(image_t* image, const char* name);
+int image_read(const image_t* image, void* data, unsigned long long* cycle, unsigned long long* time);
+
+/* the creator also removes the segment */
+void image_close(image_t* image);
+
+static inline image_entry_t* image_entry_list(const image_t* image)
+{
+	return (image_entry_t*)((char*)image -> header + image -> header -> entry_offset);
+}
+
+static inline uint8_t* image_data(const image_t* image)
+{
+	return (uint8_t*)image -> header + image -> header -> data_offset;
+}
+
+#endif
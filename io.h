@@ -1,18 +1,299 @@
 #ifndef _IO_H
 #define _IO_H
 
+/* mapping modes
+
+	IO_MAPPING_COPY : model_addr is the model variable, which is copied from
+		or to the process image on every io_exchange().
+	IO_MAPPING_DIRECT : model_addr points to a pointer variable (void**) that
+		is set to the entry's location inside the process image by
+		io_activate(). The entry is not copied by io_exchange() and the
+		application reads or writes the frame buffer directly. Only 8, 16 or
+		32 bit entries whose size equals the model size and whose domain
+		offset is aligned to that size are accepted, and only on little
+		endian targets.
+*/
+#define IO_MAPPING_COPY 0
+#define IO_MAPPING_DIRECT 1
+
+/* rate groups
+
+	rate_group is the divider of the io_exchange() cycle at which an entry
+	is exchanged. 0 and 1 exchange it on every cycle. Entries of the same
+	rate group share one EtherCAT domain, so all entries of a slave's sync
+	manager must be in the same rate group.
+*/
+
+/* distributed clocks
+
+	io_dc_configure() is called before io_activate() and enables SYNC0 on
+	every CiA402 node with the io_activate() interval as cycle time.
+	IO_DC_BUS_SHIFT : the reference clock is adjusted to the application
+		time on every cycle.
+	IO_DC_MASTER_SHIFT : the reference clock runs freely and the caller
+		adjusts its wake-up to it. io_dc_sync() returns the offset of the
+		reference clock to the application time (ns) measured on the last
+		cycle.
+	io_dc_sync() passes the application time (ns) for the next send.
+	Without it the application time advances by the interval per cycle.
+*/
+#define IO_DC_OFF 0
+#define IO_DC_BUS_SHIFT 1
+#define IO_DC_MASTER_SHIFT 2
+
+typedef struct
+{
+	unsigned long long count;
+	long long offset;
+	long long min_offset;
+	long long max_offset;
+} io_dc_stat_t;
+
+/* exchange stages
+
+	io_exchange() is io_receive() followed by io_send(). io_receive() picks
+	up the frame sent by the last io_send() and updates the inputs,
+	io_send() writes the outputs and sends the next frame, which travels
+	on the bus until the next io_receive(). The application chooses where
+	its logic runs relative to the frame:
+
+	io_receive(); proc(); io_send(); sleep
+		outputs computed from the latest inputs leave in the same cycle,
+		the frame travels while the task sleeps. The bus round trip must
+		fit into the sleep.
+	io_receive(); io_send(); proc(); sleep  (same as io_exchange(); proc();)
+		the frame is sent at the start of the cycle and travels while proc
+		runs on the inputs of the previous frame, the outputs go out one
+		cycle later. Suited to long lines where the round trip takes a
+		large part of the cycle.
+
+	Every cycle calls io_receive() and io_send() exactly once, in this
+	order.
+*/
+
+/* typed network address
+
+	addr is used instead of network_addr when network_addr is NULL, so no
+	string is formatted or parsed. IO_ROLE_OBJECT addresses the object
+	slave:index:subindex like "slave:0xindex:0xsubindex", the other roles
+	are the CiA402 logical names of the node at slave like "slave:name",
+	with IO_ROLE_FACTOR added for the factor of a scaled quantity, e.g.
+	IO_ROLE_VELOCITY | IO_ROLE_FACTOR for "slave:velocity_factor".
+	bit_length is optional (0); otherwise the object must have this length.
+*/
+#define IO_ROLE_OBJECT 0
+#define IO_ROLE_POWER 1
+#define IO_ROLE_FEEDBACK 2
+#define IO_ROLE_MODE 3
+#define IO_ROLE_TARGET 4
+#define IO_ROLE_VELOCITY 5
+#define IO_ROLE_TORQUE 6
+#define IO_ROLE_POSITION 7
+#define IO_ROLE_ACTUAL_VELOCITY 8
+#define IO_ROLE_ACTUAL_TORQUE 9
+#define IO_ROLE_FOLLOWING_ERROR 10
+#define IO_ROLE_FACTOR 0x100
+
+typedef struct
+{
+	int slave;
+	int index;
+	int subindex;
+	int bit_length;
+	int role;
+} io_addr_t;
+
+/* online remapping
+
+	io_remap() rebinds model variables while the cycle keeps running. The
+	new copy programs are built by the caller and taken over by the next
+	io_receive() (or io_exchange()), so a cycle runs either the old or the
+	new mapping completely and no cycle is lost. Only objects ("s:0xi:0xs"
+	or IO_ROLE_OBJECT) already registered by io_mapping(), in the same rate
+	group, can be bound; entries registered in advance may be given a NULL
+	model_addr there. Direct entries and CiA402 names are refused and the
+	CiA402 node bindings of io_mapping() are kept. The new list replaces
+	all other entries. io_remap() must not run in the cycle thread : it
+	waits until the cycle took the programs and fails after 1 s without a
+	cycle. The old variables are not touched once it returns.
+*/
+
+/* shared process image
+
+	io_publish_image() after io_activate() creates the POSIX shared memory
+	segment name ("/name") and from then on every io_send() (so every
+	io_exchange()) copies the process data of all domains into it with the
+	cycle count and a timestamp in ns : the DC application time with
+	distributed clocks, otherwise the last time given to io_dc_sync(),
+	otherwise the Xenomai TSC (CLOCK_MONOTONIC on the simulator), none of
+	which costs the cycle a system call. The first snapshot is taken
+	by the next io_send(), until then the cycle count is 0. Other processes read
+	consistent snapshots with image_open() and image_read() of image.h
+	without ever blocking the cycle. The segment is removed by io_cleanup().
+*/
+
+/* process data recorder
+
+	io_record_start() after io_activate() records the listed objects
+	(IO_ROLE_OBJECT addresses of entries registered by io_mapping()) at
+	every io_send() into a ring of depth cycles, which a writer thread
+	stores to path in the compact format of recorder.h. The cycle only
+	copies the entries, a full ring drops cycles and the count is stored
+	in the file. io_record_stop(), or io_cleanup(), flushes and closes the
+	file. tools/io_record_dump prints a recording as CSV.
+*/
+
+/* bus monitoring
+
+	Every io_receive() reads the working counter of the domains it picks
+	up. The master state and the states of the slave configurations are
+	read in turn, one of them every period cycles (io_monitor(), 1 by
+	default, 0 reads working counters only), so the cost per cycle does
+	not grow with the bus and n slaves are all checked within
+	(n + 1) * period cycles. io_status() returns a consistent copy of the
+	results to any thread without blocking the cycle. Everything restarts
+	at io_activate() : working counters start from IO_WC_ZERO, link_up
+	is -1 until the master was checked and a slave counts in
+	operational_count once it was seen in OP. last_slave
+	is the position of the last slave whose AL state changed (-1 none),
+	last_al_state its new state, 0 if it went offline. Domains are listed
+	in the order their rate groups were first mapped.
+*/
+#define IO_STATUS_DOMAINS 8
+
+#define IO_WC_ZERO 0
+#define IO_WC_INCOMPLETE 1
+#define IO_WC_COMPLETE 2
+
+typedef struct
+{
+	unsigned long long cycle;
+
+	int link_up;
+	int slaves_responding;
+	int al_states;
+	int slave_count;
+	int operational_count;
+
+	int domain_count;
+	int rate_group[IO_STATUS_DOMAINS];
+	unsigned int working_counter[IO_STATUS_DOMAINS];
+	int wc_state[IO_STATUS_DOMAINS];
+
+	/* events since io_activate() */
+	unsigned long long wc_fault_count;
+	unsigned long long wc_change_count;
+	unsigned long long link_change_count;
+	unsigned long long responding_change_count;
+	unsigned long long al_change_count;
+	unsigned long long op_lost_count;
+
+	int last_slave;
+	int last_al_state;
+} io_status_t;
+
+/* SDO access
+
+	io_sdo_submit() queues a read (direction 1) or write (direction 0) of
+	object index:subindex of a CiA402 node from any thread and returns at
+	once. io_receive() starts and polls a few transfers per cycle, so the
+	mailbox never blocks the cycle, and io_sdo_complete() returns finished
+	requests, state IO_SDO_DONE or IO_SDO_ERROR (abort or timeout), in any
+	order. Writes send size (1, 2 or 4) bytes of value, reads set size and
+	value (zero-extended). The request is used by the cycle until
+	io_sdo_complete() returns it. A node takes one request at a time :
+	io_sdo_submit() returns 1 until its previous request was collected.
+	context is left to the caller.
+*/
+#define IO_SDO_PENDING 0
+#define IO_SDO_DONE 1
+#define IO_SDO_ERROR 2
+
+typedef struct
+{
+	int slave;
+	int index;
+	int subindex;
+	int direction;
+	int size;
+	unsigned int value;
+	int state;
+	void* context;
+} io_sdo_t;
+
+/* PDO optimization
+
+	io_pdo_optimize() after io_init() and before the first io_mapping()
+	lists the slaves accepting a flexible PDO assignment and mapping (see
+	their ESI). io_mapping() then configures them with only the PDOs
+	holding mapped entries and, in these, only the mapped entries, so
+	unused objects no longer travel in the frame. Entries of 8 bits or
+	more stay byte aligned. After io_mapping(), io_pdo_report() gives the
+	process data bytes of a frame exchanging all rate groups, with the
+	PDOs as the slaves reported them (reported_size) and as configured
+	(size), and the number of slaves reconfigured.
+*/
+typedef struct
+{
+	unsigned int reported_size;
+	unsigned int size;
+	int slave_count;
+} io_pdo_report_t;
+
+/* topology cache
+
+	io_topology_cache() set before io_init() names a file where the PDO
+	layout of the bus is kept. Slaves whose vendor id, product code and
+	revision are unchanged since the file was written are not queried PDO
+	by PDO again, which shortens startup on large buses. An empty path or
+	NULL disables the cache; a missing or stale file is rebuilt.
+*/
+int io_topology_cache(const char* path);
+
 typedef struct
 {
 	void* model_addr;
 	int size;
 	char* network_addr;
 	int direction;
+	int mode;
+	int rate_group;
+	io_addr_t addr;
 } io_mapping_info_t;
 
+/* mapping report
+
+	After io_mapping(), io_mapping_report() gives the number of entries the
+	cycle exchanges, logical CiA402 names included and entries reserved with
+	a NULL model_addr left out, and how many of them are shorter than a
+	byte.
+*/
+typedef struct
+{
+	int entry_count;
+	int bit_entry_count;
+} io_mapping_report_t;
+
 int io_init(void);
+int io_pdo_optimize(const int* position_list, int position_count);
 int io_mapping(io_mapping_info_t* mapping_list, int mapping_count);
+int io_mapping_report(io_mapping_report_t* report);
+int io_pdo_report(io_pdo_report_t* report);
+int io_remap(io_mapping_info_t* mapping_list, int mapping_count);
 int io_activate(unsigned long long interval);
 int io_exchange(void);
+int io_receive(void);
+int io_send(void);
+int io_publish_image(const char* name);
+int io_record_start(const char* path, const io_addr_t* addr_list, int addr_count, int depth);
+int io_record_stop(void);
+int io_monitor(int period);
+int io_status(io_status_t* status);
+int io_sdo_submit(io_sdo_t* sdo);
+int io_sdo_complete(io_sdo_t** sdo);
+int io_dc_configure(int mode, int shift);
+long long io_dc_sync(unsigned long long app_time);
+int io_dc_stat(io_dc_stat_t* stat);
 int io_cleanup(void);
 
 #endif
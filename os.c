@@ -1,43 +1,135 @@
 #include "os.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <errno.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <malloc.h>
 #include <sys/mman.h>
+#ifdef OS_RT_DEBUG
+#include <stdarg.h>
+#include <execinfo.h>
+#endif
 
 #include <native/task.h>
 #include <native/timer.h>
 
 static os_sig_t registered_handler = NULL;
 
+static int memory_locked = 0;
+static long page_size = 4096;
+
+/* set by RT tasks on their own thread */
+static __thread int rt_context = 0;
+static unsigned long rt_violation_count = 0;
+
+static int task_create(os_task_t* task, os_proc_t proc, unsigned long long period,
+	const char* name, int priority, unsigned int cpu_mask);
 static void rt_task_proc(void *arg);
-static void set_rt_task_timer(RT_TASK* rt_task_plc, unsigned long long next, unsigned long long period);
+static void sync_task_proc(os_task_t* task);
+static void memory_lock(void);
+static void task_prepare(os_task_t* task);
+static void stack_prefault(int size);
+static RTIME set_rt_task_timer(RT_TASK* rt_task_plc, unsigned long long next, unsigned long long period);
 static void sigint_handler(int sig);
 
+static os_stat_t* stat_create(const char* task_name, unsigned long long period);
+static void stat_destroy(os_stat_t* stat);
+static void stat_record(os_stat_t* stat, unsigned long long latency, unsigned long long exec, unsigned long overruns);
+static void stat_value_record(os_stat_value_t* value, unsigned long long ns);
+static void stat_sync_record(os_stat_t* stat, long long offset, long long correction);
+static void stat_sync_value_record(os_stat_sync_t* value, long long ns, int first);
+
+static int cpu_list_has(const char* list, int cpu);
+static int cmdline_has(const char* cmdline, const char* key, int cpu);
+static int irq_read(int cpu, os_cpu_irq_t* irq_list, int irq_max);
+static int stat_cpu_read(int cpu, unsigned long long* busy, unsigned long long* total);
+
+#ifdef OS_RT_DEBUG
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void __libc_free(void* ptr);
+
+static __thread int rt_reporting = 0;
+
+static void debug_init(void);
+static void rt_report(const char* name, void* caller);
+static void sigxcpu_handler(int sig);
+#endif
+
+int os_memory_init(unsigned long heap_size)
+{
+	unsigned char* reserve;
+	unsigned long i;
+
+	memory_lock();
+
+	/* freed memory stays in the heap, and the heap is shared by all threads */
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+	mallopt(M_ARENA_MAX, 1);
+
+	reserve = (unsigned char*)malloc(heap_size);
+	if(reserve == NULL)
+		return 1;
+	for(i = 0; i < heap_size; i += page_size)
+		((volatile unsigned char*)reserve)[i] = 0;
+	free(reserve);
+
+	return 0;
+}
+
+unsigned long os_rt_violations(void)
+{
+	return __atomic_load_n(&rt_violation_count, __ATOMIC_RELAXED);
+}
+
+void os_task_attr_init(os_task_attr_t* attr)
+{
+	attr -> name = OS_TASK_NAME;
+	attr -> priority = OS_TASK_PRIORITY;
+	attr -> cpu_mask = 0;
+	attr -> stack_size = OS_TASK_STACK_SIZE;
+	attr -> check_isolation = 0;
+}
+
 int os_task_init(os_task_t* task, os_proc_t proc, unsigned long long period)
 {
-	RT_TASK* rt_task_plc;
-	
-    mlockall(MCL_CURRENT | MCL_FUTURE);
+	os_task_attr_t attr;
 
-	task -> data = NULL;
-	rt_task_plc = (RT_TASK*)malloc(sizeof(RT_TASK));
-	if(rt_task_plc == NULL)
+	os_task_attr_init(&attr);
+	return os_task_init_attr(task, proc, period, &attr);
+}
+
+int os_task_init_attr(os_task_t* task, os_proc_t proc, unsigned long long period, const os_task_attr_t* attr)
+{
+	int i;
+	os_cpu_report_t report;
+
+	if(attr == NULL || attr -> name == NULL || attr -> stack_size < 0 || (attr -> cpu_mask & ~0xffu) != 0)
 		return 1;
 
-	if(rt_task_create(rt_task_plc, "rt_task_plc", 0, 50, T_JOINABLE))
+	memory_lock();
+
+	/* interference is reported, the task may still meet its deadlines */
+	if(attr -> check_isolation)
 	{
-		free(rt_task_plc);
-		return 1;
+		for(i = 0; i < 8; i++)
+		{
+			if((attr -> cpu_mask & (1 << i)) && os_cpu_check(i, OS_CPU_CHECK_INTERVAL, &report) != 0)
+				os_cpu_print(&report);
+		}
 	}
 
-	task -> proc = proc;
-	task -> period = period;
-	task -> alive = 0;
-	task -> data = (void*)rt_task_plc;
-
-	return 0;
+	task -> start = 0;
+	task -> sync = NULL;
+	task -> stack_size = attr -> stack_size;
+	return task_create(task, proc, period, attr -> name, attr -> priority, attr -> cpu_mask);
 }
 
 int os_task_start(os_task_t* task)
@@ -49,28 +141,348 @@ int os_task_start(os_task_t* task)
 
 	task -> alive = 1;
 	if(rt_task_start((RT_TASK*)(task -> data), &rt_task_proc, task))
+	{
+		task -> alive = 0;
 		return 1;
+	}
+	task -> started = 1;
 	rt_task_join((RT_TASK*)(task -> data));
 
 	return 0;
 }
 
+int os_task_sync(os_task_t* task, os_sync_t sync)
+{
+	if(task -> alive)
+		return 1;
+
+	task -> sync = sync;
+	return 0;
+}
+
 int os_task_stop(os_task_t* task)
 {
 	task -> alive = 0;
 
 	if(task -> data != NULL)
 	{
-		rt_task_join((RT_TASK*)(task -> data));
+		if(task -> started)
+			rt_task_join((RT_TASK*)(task -> data));
 		rt_task_delete((RT_TASK*)(task -> data));
+		task -> started = 0;
 
 		free(task -> data);
 		task -> data = NULL;
 	}
 
+	if(task -> stat != NULL)
+	{
+		stat_destroy(task -> stat);
+		task -> stat = NULL;
+	}
+
+	return 0;
+}
+
+int os_sched_init(os_sched_t* sched)
+{
+	memset(sched, 0, sizeof(os_sched_t));
+	memory_lock();
+
 	return 0;
 }
 
+os_task_t* os_sched_add(os_sched_t* sched, os_proc_t proc, unsigned long long period, unsigned int cpu_mask)
+{
+	os_task_t* task;
+
+	if(sched -> task_count == OS_SCHED_MAX_TASKS || period == 0)
+		return NULL;
+
+	/* the RT task is created with its priority on start */
+	task = &(sched -> task_list[sched -> task_count]);
+	memset(task, 0, sizeof(os_task_t));
+	task -> proc = proc;
+	task -> period = period;
+	task -> cpu_mask = cpu_mask;
+	snprintf(task -> name, sizeof(task -> name), "rt_task_plc%d", sched -> task_count);
+	sched -> task_count++;
+
+	return task;
+}
+
+int os_sched_start(os_sched_t* sched)
+{
+	int i, j, k, rank;
+	os_task_t* task;
+
+	/* rate-monotonic priority : rank of the period among distinct periods */
+	for(i = 0; i < sched -> task_count; i++)
+	{
+		task = &(sched -> task_list[i]);
+		rank = 0;
+		for(j = 0; j < sched -> task_count; j++)
+		{
+			if(sched -> task_list[j].period >= task -> period)
+				continue;
+
+			for(k = 0; k < j; k++)
+			{
+				if(sched -> task_list[k].period == sched -> task_list[j].period)
+					break;
+			}
+			if(k == j)
+				rank++;
+		}
+		task -> priority = OS_SCHED_TOP_PRIORITY - rank;
+	}
+
+	for(i = 0; i < sched -> task_count; i++)
+	{
+		task = &(sched -> task_list[i]);
+		if(task_create(task, task -> proc, task -> period, task -> name, task -> priority, task -> cpu_mask) != 0)
+		{
+			os_sched_stop(sched);
+			return 1;
+		}
+	}
+
+	/* common first release for phase alignment */
+	sched -> epoch = rt_timer_read() + rt_timer_ns2ticks(OS_SCHED_LEAD);
+	for(i = 0; i < sched -> task_count; i++)
+	{
+		task = &(sched -> task_list[i]);
+		task -> start = sched -> epoch;
+		task -> alive = 1;
+		if(rt_task_start((RT_TASK*)(task -> data), &rt_task_proc, task))
+		{
+			task -> alive = 0;
+			os_sched_stop(sched);
+			return 1;
+		}
+		task -> started = 1;
+	}
+
+	return 0;
+}
+
+int os_sched_join(os_sched_t* sched)
+{
+	int i;
+
+	for(i = 0; i < sched -> task_count; i++)
+	{
+		if(sched -> task_list[i].data != NULL && sched -> task_list[i].started)
+			rt_task_join((RT_TASK*)(sched -> task_list[i].data));
+	}
+
+	return 0;
+}
+
+int os_sched_stop(os_sched_t* sched)
+{
+	int i;
+
+	for(i = 0; i < sched -> task_count; i++)
+		sched -> task_list[i].alive = 0;
+
+	for(i = 0; i < sched -> task_count; i++)
+		os_task_stop(&(sched -> task_list[i]));
+
+	return 0;
+}
+
+int os_cpu_check(int cpu, unsigned int interval_ms, os_cpu_report_t* report)
+{
+	static os_cpu_irq_t before_list[OS_CPU_IRQ_MAX];
+	static os_cpu_irq_t after_list[OS_CPU_IRQ_MAX];
+	char buffer[4096];
+	FILE* file;
+	int before_count, after_count;
+	int i, j, k;
+	unsigned long long count;
+	unsigned long long busy_before, total_before, busy_after, total_after;
+
+	memset(report, 0, sizeof(os_cpu_report_t));
+	report -> cpu = cpu;
+	report -> interval_ms = interval_ms;
+	if(cpu < 0)
+		return -1;
+
+	file = fopen("/sys/devices/system/cpu/isolated", "r");
+	if(file != NULL)
+	{
+		if(fgets(buffer, sizeof(buffer), file) != NULL)
+			report -> isolated = cpu_list_has(buffer, cpu);
+		fclose(file);
+	}
+
+	file = fopen("/proc/cmdline", "r");
+	if(file != NULL)
+	{
+		if(fgets(buffer, sizeof(buffer), file) != NULL)
+		{
+			/* kernels without the sysfs file still know isolcpus= */
+			if(!report -> isolated)
+				report -> isolated = cmdline_has(buffer, "isolcpus=", cpu);
+			report -> nohz_full = cmdline_has(buffer, "nohz_full=", cpu);
+			report -> rcu_nocbs = cmdline_has(buffer, "rcu_nocbs=", cpu);
+		}
+		fclose(file);
+	}
+
+	before_count = irq_read(cpu, before_list, OS_CPU_IRQ_MAX);
+	if(before_count < 0 || stat_cpu_read(cpu, &busy_before, &total_before) != 0)
+		return -1;
+
+	usleep(interval_ms * 1000);
+
+	after_count = irq_read(cpu, after_list, OS_CPU_IRQ_MAX);
+	if(after_count < 0 || stat_cpu_read(cpu, &busy_after, &total_after) != 0)
+		return -1;
+
+	for(i = 0; i < after_count; i++)
+	{
+		count = after_list[i].count;
+		for(j = 0; j < before_count; j++)
+		{
+			if(strcmp(before_list[j].name, after_list[i].name) == 0)
+			{
+				count -= before_list[j].count;
+				break;
+			}
+		}
+		if(count == 0)
+			continue;
+		report -> irq_count += count;
+
+		/* keep the busiest sources, in descending order */
+		for(k = report -> irq_source_count; k > 0 && report -> irq_source_list[k - 1].count < count; k--)
+		{
+			if(k < OS_CPU_IRQ_REPORT)
+				report -> irq_source_list[k] = report -> irq_source_list[k - 1];
+		}
+		if(k < OS_CPU_IRQ_REPORT)
+		{
+			memcpy(report -> irq_source_list[k].name, after_list[i].name, sizeof(after_list[i].name));
+			report -> irq_source_list[k].count = count;
+			if(report -> irq_source_count < OS_CPU_IRQ_REPORT)
+				report -> irq_source_count++;
+		}
+	}
+
+	if(total_after > total_before)
+		report -> busy_permille = (unsigned int)((busy_after - busy_before) * 1000 / (total_after - total_before));
+
+	if(report -> isolated && report -> irq_count == 0 && report -> busy_permille == 0)
+		return 0;
+	return 1;
+}
+
+void os_cpu_print(const os_cpu_report_t* report)
+{
+	int i;
+
+	printf("OS CPU %d is %sisolated, nohz_full %s, rcu_nocbs %s.\n", report -> cpu,
+		report -> isolated ? "" : "not ", report -> nohz_full ? "on" : "off", report -> rcu_nocbs ? "on" : "off");
+	printf("OS CPU %d served %llu interrupts and was busy %u.%u%% in %u ms.\n", report -> cpu,
+		report -> irq_count, report -> busy_permille / 10, report -> busy_permille % 10, report -> interval_ms);
+	for(i = 0; i < report -> irq_source_count; i++)
+		printf("OS     %s : %llu\n", report -> irq_source_list[i].name, report -> irq_source_list[i].count);
+}
+
+os_stat_t* os_stat_attach(const char* task_name)
+{
+	int fd;
+	char name[64];
+	os_stat_t* stat;
+
+	snprintf(name, sizeof(name), "%s%s", OS_STAT_PREFIX, task_name);
+	fd = shm_open(name, O_RDONLY, 0);
+	if(fd < 0)
+		return NULL;
+
+	stat = (os_stat_t*)mmap(NULL, sizeof(os_stat_t), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(stat == MAP_FAILED)
+		return NULL;
+
+	if(stat -> magic != OS_STAT_MAGIC)
+	{
+		munmap(stat, sizeof(os_stat_t));
+		return NULL;
+	}
+
+	return stat;
+}
+
+int os_stat_detach(os_stat_t* stat)
+{
+	if(stat == NULL)
+		return 1;
+
+	return munmap(stat, sizeof(os_stat_t));
+}
+
+int os_stat_summary(const os_stat_t* stat, os_stat_summary_t* summary)
+{
+	unsigned int seq;
+
+	if(stat == NULL)
+		return 1;
+
+	do
+	{
+		while((seq = stat -> seq) & 1)
+			;
+		__sync_synchronize();
+		memcpy(summary, (const void*)&(stat -> summary), sizeof(os_stat_summary_t));
+		__sync_synchronize();
+	} while(seq != stat -> seq);
+
+	return 0;
+}
+
+int os_stat_poll(const os_stat_t* stat, unsigned long long* cursor, os_stat_sample_t* sample_list, int sample_count)
+{
+	int i, count;
+	unsigned long long head;
+
+	if(stat == NULL)
+		return -1;
+
+	head = stat -> head;
+	__sync_synchronize();
+
+	/* samples older than the ring are lost, the oldest slot is the one written next */
+	if(head - *cursor >= OS_STAT_RING_SIZE)
+		*cursor = head - OS_STAT_RING_SIZE + 1;
+
+	count = (int)(head - *cursor);
+	if(count > sample_count)
+		count = sample_count;
+
+	for(i = 0; i < count; i++)
+		sample_list[i] = stat -> ring[(*cursor + i) % OS_STAT_RING_SIZE];
+
+	/* drop samples overwritten while copying */
+	__sync_synchronize();
+	head = stat -> head;
+	if(head - *cursor >= OS_STAT_RING_SIZE)
+	{
+		i = (int)(head - *cursor - OS_STAT_RING_SIZE + 1);
+		if(i > count)
+			i = count;
+		memmove(sample_list, sample_list + i, sizeof(os_stat_sample_t) * (count - i));
+		*cursor += i;
+		count -= i;
+	}
+
+	*cursor += count;
+
+	return count;
+}
+
 int os_signal(os_sig_t handler)
 {
 	registered_handler = handler;
@@ -88,23 +500,205 @@ void* os_memcpy(void* s1, const void* s2, unsigned int n)
 	return memcpy(s1, s2, (size_t)n);
 }
 
+static int task_create(os_task_t* task, os_proc_t proc, unsigned long long period,
+	const char* name, int priority, unsigned int cpu_mask)
+{
+	int i;
+	int mode = T_JOINABLE;
+	RT_TASK* rt_task_plc;
+
+	task -> data = NULL;
+	task -> stat = NULL;
+	rt_task_plc = (RT_TASK*)malloc(sizeof(RT_TASK));
+	if(rt_task_plc == NULL)
+		return 1;
+
+	for(i = 0; i < 8; i++)
+	{
+		if(cpu_mask & (1 << i))
+			mode |= T_CPU(i);
+	}
+
+	if(task -> stack_size == 0)
+		task -> stack_size = OS_TASK_STACK_SIZE;
+
+	if(rt_task_create(rt_task_plc, name, task -> stack_size, priority, mode))
+	{
+		free(rt_task_plc);
+		return 1;
+	}
+
+	if(task -> name != name)
+		snprintf(task -> name, sizeof(task -> name), "%s", name);
+	task -> proc = proc;
+	task -> period = period;
+	task -> priority = priority;
+	task -> cpu_mask = cpu_mask;
+	task -> alive = 0;
+	task -> started = 0;
+	task -> data = (void*)rt_task_plc;
+	task -> stat = stat_create(name, period);
+
+	return 0;
+}
+
 static void rt_task_proc(void *arg)
 {
 	os_task_t* task = (os_task_t*)arg;
+	RTIME period = rt_timer_ns2ticks(task -> period);
+	RTIME release, start, end;
+	unsigned long overruns = 0;
+	int first = 1;
+	int ret;
+
+	task_prepare(task);
+
+	if(task -> sync != NULL)
+	{
+		sync_task_proc(task);
+		rt_context = 0;
+		return;
+	}
 
-	set_rt_task_timer((RT_TASK*)(task -> data), task -> period, task -> period);
+	/* scheduled tasks wait for the common epoch before the first cycle */
+	if(task -> start != 0)
+	{
+		release = task -> start;
+		rt_task_set_periodic(NULL, release, period);
+		rt_task_wait_period(&overruns);
+		release += period * overruns;
+		overruns = 0;
+		first = 0;
+	}
+	else
+		release = set_rt_task_timer((RT_TASK*)(task -> data), task -> period, task -> period);
 
 	while(task -> alive)
 	{
+		start = rt_timer_read();
 		task -> proc();
-		rt_task_wait_period(NULL);
+		end = rt_timer_read();
+
+		/* the first cycle is not released by the timer */
+		if(!first)
+		{
+			stat_record(task -> stat, rt_timer_ticks2ns(start - release), rt_timer_ticks2ns(end - start), overruns);
+			release += period;
+		}
+		first = 0;
+
+		/* on overrun, the task is released at the latest missed point */
+		overruns = 0;
+		ret = rt_task_wait_period(&overruns);
+		if(ret != 0 && ret != -ETIMEDOUT)
+			overruns = 0;
+		release += period * overruns;
 	}
+
+	/* thread teardown frees on this thread */
+	rt_context = 0;
+}
+
+static void sync_task_proc(os_task_t* task)
+{
+	RTIME period = rt_timer_ns2ticks(task -> period);
+	RTIME release, start, end;
+	long long max_step = task -> period / OS_SYNC_STEP_DIVIDER;
+	long long offset, step;
+	long long correction = 0;
+	long long integral = 0;
+	unsigned long overruns;
+
+	/* wake-ups are single shots, so each one can be moved */
+	if(task -> start != 0)
+		release = task -> start;
+	else
+		release = rt_timer_read() + period;
+
+	while(task -> alive)
+	{
+		rt_task_sleep_until(release);
+		start = rt_timer_read();
+
+		/* on overrun, the task is released at the latest missed point */
+		overruns = 0;
+		while(start >= release + period)
+		{
+			release += period;
+			overruns++;
+		}
+
+		offset = task -> sync(rt_timer_ticks2ns(release) + correction);
+		task -> proc();
+		end = rt_timer_read();
+
+		stat_sync_record(task -> stat, offset, correction);
+		stat_record(task -> stat, rt_timer_ticks2ns(start - release), rt_timer_ticks2ns(end - start), overruns);
+
+		/* PI controller, kp = 1/8 and ki = 1/64 */
+		integral += offset;
+		if(integral > max_step * 64)
+			integral = max_step * 64;
+		if(integral < -max_step * 64)
+			integral = -max_step * 64;
+
+		step = offset / 8 + integral / 64;
+		if(step > max_step)
+			step = max_step;
+		if(step < -max_step)
+			step = -max_step;
+
+		correction += step;
+		release += period - rt_timer_ns2ticks(step);
+	}
+}
+
+/* a task without locked memory still runs, its cycles may stall on page faults */
+static void memory_lock(void)
+{
+	if(memory_locked)
+		return;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	if(page_size <= 0)
+		page_size = 4096;
+
+	if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+		printf("OS locking memory failed!\n");
+
+#ifdef OS_RT_DEBUG
+	debug_init();
+#endif
+	memory_locked = 1;
+}
+
+static void task_prepare(os_task_t* task)
+{
+	if(task -> stack_size > OS_STACK_MARGIN)
+		stack_prefault(task -> stack_size - OS_STACK_MARGIN);
+
+#ifdef OS_RT_DEBUG
+	rt_task_set_mode(0, T_WARNSW, NULL);
+#endif
+	rt_context = 1;
+}
+
+/* page faults on the stack would stall the first cycles that reach deeper */
+static void __attribute__((noinline)) stack_prefault(int size)
+{
+	unsigned char stack[size];
+	long i;
+
+	for(i = 0; i < size; i += page_size)
+		stack[i] = 0;
+	__asm__ __volatile__("" : : "r"(stack) : "memory");
 }
 
-void set_rt_task_timer(RT_TASK* rt_task_plc, unsigned long long next, unsigned long long period)
+static RTIME set_rt_task_timer(RT_TASK* rt_task_plc, unsigned long long next, unsigned long long period)
 {
 	RTIME current_time = rt_timer_read();
 	rt_task_set_periodic(rt_task_plc, current_time + next, rt_timer_ns2ticks(period));
+	return current_time + next;
 }
 
 static void sigint_handler(int sig)
@@ -112,3 +706,364 @@ static void sigint_handler(int sig)
 	if(registered_handler != NULL)
 		registered_handler();
 }
+
+static os_stat_t* stat_create(const char* task_name, unsigned long long period)
+{
+	int fd;
+	char name[64];
+	os_stat_t* stat = NULL;
+
+	/* statistics are shared if possible, otherwise kept private */
+	snprintf(name, sizeof(name), "%s%s", OS_STAT_PREFIX, task_name);
+	fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+	if(fd >= 0)
+	{
+		if(ftruncate(fd, sizeof(os_stat_t)) == 0)
+		{
+			stat = (os_stat_t*)mmap(NULL, sizeof(os_stat_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if(stat == MAP_FAILED)
+				stat = NULL;
+		}
+		close(fd);
+
+		if(stat == NULL)
+			shm_unlink(name);
+	}
+
+	if(stat == NULL)
+	{
+		stat = (os_stat_t*)malloc(sizeof(os_stat_t));
+		if(stat == NULL)
+			return NULL;
+		memset(stat, 0, sizeof(os_stat_t));
+	}
+	else
+	{
+		memset(stat, 0, sizeof(os_stat_t));
+		stat -> shared = 1;
+	}
+
+	strncpy(stat -> name, task_name, sizeof(stat -> name) - 1);
+	stat -> period = period;
+	stat -> summary.latency.min = ~0ULL;
+	stat -> summary.exec.min = ~0ULL;
+	__sync_synchronize();
+	stat -> magic = OS_STAT_MAGIC;
+
+	return stat;
+}
+
+static void stat_destroy(os_stat_t* stat)
+{
+	char name[64];
+
+	if(stat -> shared)
+	{
+		snprintf(name, sizeof(name), "%s%s", OS_STAT_PREFIX, stat -> name);
+		munmap(stat, sizeof(os_stat_t));
+		shm_unlink(name);
+	}
+	else
+		free(stat);
+}
+
+static void stat_record(os_stat_t* stat, unsigned long long latency, unsigned long long exec, unsigned long overruns)
+{
+	os_stat_sample_t* sample;
+
+	if(stat == NULL)
+		return;
+
+	stat -> seq++;
+	__sync_synchronize();
+
+	stat -> summary.cycles++;
+	stat -> summary.overruns += overruns;
+	stat_value_record(&(stat -> summary.latency), latency);
+	stat_value_record(&(stat -> summary.exec), exec);
+
+	__sync_synchronize();
+	stat -> seq++;
+
+	sample = &(stat -> ring[stat -> head % OS_STAT_RING_SIZE]);
+	sample -> cycle = stat -> summary.cycles;
+	sample -> latency = latency > 0xffffffffULL ? 0xffffffff : (unsigned int)latency;
+	sample -> exec = exec > 0xffffffffULL ? 0xffffffff : (unsigned int)exec;
+	sample -> overruns = (unsigned int)overruns;
+
+	/* publish the sample after it is written */
+	__sync_synchronize();
+	stat -> head++;
+}
+
+static void stat_sync_record(os_stat_t* stat, long long offset, long long correction)
+{
+	int first;
+
+	if(stat == NULL)
+		return;
+
+	stat -> seq++;
+	__sync_synchronize();
+
+	first = stat -> summary.sync_cycles == 0;
+	stat_sync_value_record(&(stat -> summary.sync_offset), offset, first);
+	stat_sync_value_record(&(stat -> summary.sync_correction), correction, first);
+	stat -> summary.sync_cycles++;
+
+	__sync_synchronize();
+	stat -> seq++;
+}
+
+static void stat_sync_value_record(os_stat_sync_t* value, long long ns, int first)
+{
+	if(first || ns < value -> min)
+		value -> min = ns;
+	if(first || ns > value -> max)
+		value -> max = ns;
+	value -> last = ns;
+}
+
+static void stat_value_record(os_stat_value_t* value, unsigned long long ns)
+{
+	int bucket = 0;
+
+	if(ns < value -> min)
+		value -> min = ns;
+	if(ns > value -> max)
+		value -> max = ns;
+	value -> sum += ns;
+
+	if(ns != 0)
+	{
+		bucket = 64 - __builtin_clzll(ns);
+		if(bucket >= OS_STAT_HIST_SIZE)
+			bucket = OS_STAT_HIST_SIZE - 1;
+	}
+	value -> hist[bucket]++;
+}
+
+/* CPU lists like "1,3-5", other words (isolcpus= flags) are skipped */
+static int cpu_list_has(const char* list, int cpu)
+{
+	const char* cursor = list;
+	char* end;
+	long first, last;
+
+	while(*cursor != '\0' && !isspace((unsigned char)*cursor))
+	{
+		if(isdigit((unsigned char)*cursor))
+		{
+			first = strtol(cursor, &end, 10);
+			last = first;
+			if(*end == '-')
+				last = strtol(end + 1, &end, 10);
+			if(cpu >= first && cpu <= last)
+				return 1;
+			cursor = end;
+		}
+
+		while(*cursor != '\0' && *cursor != ',' && !isspace((unsigned char)*cursor))
+			cursor++;
+		if(*cursor == ',')
+			cursor++;
+	}
+
+	return 0;
+}
+
+static int cmdline_has(const char* cmdline, const char* key, int cpu)
+{
+	const char* cursor = cmdline;
+
+	while((cursor = strstr(cursor, key)) != NULL)
+	{
+		if(cursor == cmdline || isspace((unsigned char)cursor[-1]))
+			return cpu_list_has(cursor + strlen(key), cpu);
+		cursor++;
+	}
+
+	return 0;
+}
+
+static int irq_read(int cpu, os_cpu_irq_t* irq_list, int irq_max)
+{
+	FILE* file;
+	char* line = NULL;
+	size_t size = 0;
+	char* cursor;
+	char* end;
+	char name[16];
+	int column = -1;
+	int count = 0;
+	int i, n, width;
+	unsigned long long value;
+
+	file = fopen("/proc/interrupts", "r");
+	if(file == NULL)
+		return -1;
+
+	/* the header names the columns of the online CPUs */
+	if(getline(&line, &size, file) > 0)
+	{
+		cursor = line;
+		for(i = 0; sscanf(cursor, " CPU%d%n", &n, &width) == 1; i++)
+		{
+			if(n == cpu)
+			{
+				column = i;
+				break;
+			}
+			cursor += width;
+		}
+	}
+
+	while(column >= 0 && count < irq_max && getline(&line, &size, file) > 0)
+	{
+		if(sscanf(line, " %15[^:]:%n", name, &n) != 1)
+			continue;
+
+		cursor = line + n;
+		for(i = 0; i <= column; i++)
+		{
+			value = strtoull(cursor, &end, 10);
+			if(end == cursor)
+				break;
+			cursor = end;
+		}
+		if(i <= column)
+			continue;
+
+		memcpy(irq_list[count].name, name, sizeof(name));
+		irq_list[count].count = value;
+		count++;
+	}
+
+	free(line);
+	fclose(file);
+
+	return column >= 0 ? count : -1;
+}
+
+static int stat_cpu_read(int cpu, unsigned long long* busy, unsigned long long* total)
+{
+	FILE* file;
+	char line[256];
+	int n;
+	int ret = 1;
+	unsigned long long user, nice, system, idle, iowait, irq, softirq, steal;
+
+	file = fopen("/proc/stat", "r");
+	if(file == NULL)
+		return 1;
+
+	while(fgets(line, sizeof(line), file) != NULL)
+	{
+		user = nice = system = idle = iowait = irq = softirq = steal = 0;
+		if(sscanf(line, "cpu%d %llu %llu %llu %llu %llu %llu %llu %llu", &n,
+			&user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal) >= 5 && n == cpu)
+		{
+			*total = user + nice + system + idle + iowait + irq + softirq + steal;
+			*busy = *total - idle - iowait;
+			ret = 0;
+			break;
+		}
+	}
+
+	fclose(file);
+
+	return ret;
+}
+
+#ifdef OS_RT_DEBUG
+void* malloc(size_t size)
+{
+	rt_report("malloc", __builtin_return_address(0));
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+	rt_report("calloc", __builtin_return_address(0));
+	return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+	rt_report("realloc", __builtin_return_address(0));
+	return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr)
+{
+	rt_report("free", __builtin_return_address(0));
+	__libc_free(ptr);
+}
+
+int printf(const char* format, ...)
+{
+	int ret;
+	va_list args;
+
+	rt_report("printf", __builtin_return_address(0));
+	va_start(args, format);
+	ret = vprintf(format, args);
+	va_end(args);
+
+	return ret;
+}
+
+int puts(const char* text)
+{
+	rt_report("puts", __builtin_return_address(0));
+	return fputs(text, stdout) < 0 || fputc('\n', stdout) == EOF ? EOF : 1;
+}
+
+static void debug_init(void)
+{
+	void* frame;
+
+	/* the first backtrace() loads libgcc, which allocates */
+	backtrace(&frame, 1);
+	signal(SIGXCPU, sigxcpu_handler);
+}
+
+static void rt_report(const char* name, void* caller)
+{
+	char line[128];
+	void* frame_list[OS_RT_DEBUG_DEPTH];
+	int count;
+
+	if(!rt_context || rt_reporting)
+		return;
+
+	/* the report itself allocates and switches mode */
+	rt_reporting = 1;
+	rt_task_set_mode(T_WARNSW, 0, NULL);
+	__atomic_add_fetch(&rt_violation_count, 1, __ATOMIC_RELAXED);
+
+	count = snprintf(line, sizeof(line), "OS %s() called from RT task at %p!\n", name, caller);
+	if(write(STDERR_FILENO, line, count) == count)
+	{
+		count = backtrace(frame_list, OS_RT_DEBUG_DEPTH);
+		backtrace_symbols_fd(frame_list + 2, count - 2, STDERR_FILENO);
+	}
+
+	rt_task_set_mode(0, T_WARNSW, NULL);
+	rt_reporting = 0;
+}
+
+static void sigxcpu_handler(int sig)
+{
+	static const char line[] = "OS RT task switched to secondary mode!\n";
+	void* frame_list[OS_RT_DEBUG_DEPTH];
+	int count;
+
+	__atomic_add_fetch(&rt_violation_count, 1, __ATOMIC_RELAXED);
+	if(write(STDERR_FILENO, line, sizeof(line) - 1) == sizeof(line) - 1)
+	{
+		count = backtrace(frame_list, OS_RT_DEBUG_DEPTH);
+		backtrace_symbols_fd(frame_list + 1, count - 1, STDERR_FILENO);
+	}
+}
+#endif
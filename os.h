@@ -3,18 +3,233 @@
 
 typedef void (*os_proc_t)(void);
 typedef void (*os_sig_t)(void);
+typedef long long (*os_sync_t)(unsigned long long now);
+
+/* task statistics
+
+	The periodic task records its wake-up latency (actual - scheduled
+	release), the execution time of proc and the overruns reported by the
+	OS on every cycle. The statistics live in a shared memory object named
+	OS_STAT_PREFIX + task name, so that a non-RT process can poll them with
+	os_stat_attach() without disturbing the task.
+
+	Tasks synchronised with os_task_sync() also record the clock offset
+	returned by the sync hook and the accumulated wake-up correction.
+
+	Histogram bucket i counts values in [2^(i-1), 2^i) ns, bucket 0 counts 0.
+	Summary values are guarded by seq (odd while updating), samples of the
+	last OS_STAT_RING_SIZE cycles are kept in a ring indexed by head.
+*/
+#define OS_STAT_PREFIX "/os_stat_"
+#define OS_STAT_MAGIC 0x4f535431
+#define OS_STAT_HIST_SIZE 32
+#define OS_STAT_RING_SIZE 1024
+
+typedef struct
+{
+	unsigned long long min;
+	unsigned long long max;
+	unsigned long long sum;
+	unsigned long long hist[OS_STAT_HIST_SIZE];
+} os_stat_value_t;
+
+typedef struct
+{
+	long long last;
+	long long min;
+	long long max;
+} os_stat_sync_t;
+
+typedef struct
+{
+	unsigned long long cycles;
+	unsigned long long overruns;
+	os_stat_value_t latency;
+	os_stat_value_t exec;
+
+	unsigned long long sync_cycles;
+	os_stat_sync_t sync_offset;
+	os_stat_sync_t sync_correction;
+} os_stat_summary_t;
+
+typedef struct
+{
+	unsigned long long cycle;
+	unsigned int latency;
+	unsigned int exec;
+	unsigned int overruns;
+} os_stat_sample_t;
+
+typedef struct
+{
+	unsigned int magic;
+	int shared;
+	char name[32];
+	unsigned long long period;
+
+	volatile unsigned int seq;
+	os_stat_summary_t summary;
+
+	volatile unsigned long long head;
+	os_stat_sample_t ring[OS_STAT_RING_SIZE];
+} os_stat_t;
 
 typedef struct
 {
 	os_proc_t proc;
 	unsigned long long period;
 	int alive;
+	/* only started RT tasks are joined, created ones are just deleted */
+	int started;
 	void* data;
+	os_stat_t* stat;
+
+	char name[32];
+	int priority;
+	unsigned int cpu_mask;
+	int stack_size;
+	unsigned long long start;
+	os_sync_t sync;
 } os_task_t;
 
+/* task attributes
+
+	os_task_init_attr() takes the name, priority, CPU mask (bit n = CPU n,
+	0 = any), stack size and isolation check of the task from attr.
+	os_task_attr_init() fills attr with the defaults that os_task_init()
+	uses. With check_isolation set, every CPU of the mask is checked with
+	os_cpu_check() before the task is created and any interference is
+	printed; the task is created anyway.
+*/
+#define OS_TASK_NAME "rt_task_plc"
+#define OS_TASK_PRIORITY 50
+
+typedef struct
+{
+	const char* name;
+	int priority;
+	unsigned int cpu_mask;
+	int stack_size;
+	int check_isolation;
+} os_task_attr_t;
+
+/* CPU isolation check
+
+	os_cpu_check() reports whether a CPU is listed in
+	/sys/devices/system/cpu/isolated and in the nohz_full= and rcu_nocbs=
+	boot parameters, then samples /proc/interrupts and /proc/stat over
+	interval_ms : every interrupt served by the CPU in that time and any
+	time it spent outside the idle task count as interference. The
+	OS_CPU_IRQ_REPORT busiest interrupt sources are kept in the report. It
+	returns 0 for an isolated, quiet CPU, 1 otherwise and -1 if the files
+	cannot be read.
+*/
+#define OS_CPU_CHECK_INTERVAL 1000
+#define OS_CPU_IRQ_REPORT 8
+#define OS_CPU_IRQ_MAX 256
+
+typedef struct
+{
+	char name[16];
+	unsigned long long count;
+} os_cpu_irq_t;
+
+typedef struct
+{
+	int cpu;
+	int isolated;
+	int nohz_full;
+	int rcu_nocbs;
+
+	unsigned int interval_ms;
+	unsigned long long irq_count;
+	int irq_source_count;
+	os_cpu_irq_t irq_source_list[OS_CPU_IRQ_REPORT];
+
+	/* non-idle share of the interval */
+	unsigned int busy_permille;
+} os_cpu_report_t;
+
+/* clock synchronisation
+
+	A task with a sync hook follows an external clock, e.g. the EtherCAT DC
+	reference clock. Every cycle the hook gets the task's release time plus
+	the correction (ns) and returns the offset of the external clock to it.
+	A PI controller moves the correction and so the following wake-ups
+	towards the external clock, by at most period / OS_SYNC_STEP_DIVIDER
+	per cycle. The hook is set before the task is started.
+*/
+#define OS_SYNC_STEP_DIVIDER 1000
+
+/* periodic task scheduler
+
+	Tasks are added with their period and CPU mask (bit n = CPU n, 0 = any)
+	and get rate-monotonic priorities on os_sched_start(): the shortest
+	period gets OS_SCHED_TOP_PRIORITY, every longer period one less. All
+	tasks are released first at a common epoch, so harmonic tasks stay
+	phase-aligned. os_sched_start() does not block, os_sched_join() waits
+	for all tasks.
+*/
+#define OS_SCHED_MAX_TASKS 8
+#define OS_SCHED_TOP_PRIORITY 90
+#define OS_SCHED_LEAD 10000000ULL
+
+typedef struct
+{
+	os_task_t task_list[OS_SCHED_MAX_TASKS];
+	int task_count;
+	unsigned long long epoch;
+} os_sched_t;
+
+/* memory discipline
+
+	Task creation and os_sched_init() lock all current and future pages;
+	if that fails they only warn, the tasks run with possible page faults.
+	os_memory_init(), called by the application before the first task is
+	created, also keeps malloc from trimming the heap, from serving large
+	blocks with mmap and from opening per-thread arenas, and touches a heap
+	reserve of heap_size bytes (e.g. OS_HEAP_RESERVE) before freeing it
+	again, so later allocations are served from resident memory. It fails
+	only if the reserve cannot be allocated.
+
+	RT tasks get OS_TASK_STACK_SIZE bytes of stack unless their attributes
+	say otherwise, and touch all of it but OS_STACK_MARGIN bytes themselves
+	before their first cycle.
+
+	Built with OS_RT_DEBUG, malloc(), calloc(), realloc(), free(), printf()
+	and puts() called from an RT task are reported on stderr with their
+	call site and counted by os_rt_violations(). RT tasks also run with
+	T_WARNSW, so any other switch to secondary mode is reported with a
+	backtrace from SIGXCPU.
+*/
+#define OS_HEAP_RESERVE (8UL * 1024 * 1024)
+#define OS_TASK_STACK_SIZE (256 * 1024)
+#define OS_STACK_MARGIN (32 * 1024)
+#define OS_RT_DEBUG_DEPTH 16
+
+int os_memory_init(unsigned long heap_size);
+unsigned long os_rt_violations(void);
+
+void os_task_attr_init(os_task_attr_t* attr);
 int os_task_init(os_task_t* task, os_proc_t proc, unsigned long long period);
+int os_task_init_attr(os_task_t* task, os_proc_t proc, unsigned long long period, const os_task_attr_t* attr);
 int os_task_start(os_task_t* task);
 int os_task_stop(os_task_t* task);
+int os_task_sync(os_task_t* task, os_sync_t sync);
+
+int os_sched_init(os_sched_t* sched);
+os_task_t* os_sched_add(os_sched_t* sched, os_proc_t proc, unsigned long long period, unsigned int cpu_mask);
+int os_sched_start(os_sched_t* sched);
+int os_sched_join(os_sched_t* sched);
+int os_sched_stop(os_sched_t* sched);
+
+int os_cpu_check(int cpu, unsigned int interval_ms, os_cpu_report_t* report);
+void os_cpu_print(const os_cpu_report_t* report);
+
+os_stat_t* os_stat_attach(const char* task_name);
+int os_stat_detach(os_stat_t* stat);
+int os_stat_summary(const os_stat_t* stat, os_stat_summary_t* summary);
+int os_stat_poll(const os_stat_t* stat, unsigned long long* cursor, os_stat_sample_t* sample_list, int sample_count);
 
 int os_signal(os_sig_t handler);
 void os_exit(int value);
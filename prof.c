@@ -0,0 +1,97 @@
+#include "prof.h"
+
+#include <string.h>
+#include <time.h>
+
+prof_stat_t prof_stat_list[PROF_PHASE_COUNT];
+
+static double ns_per_tick = 0.0;
+
+static const char* phase_name_list[PROF_PHASE_COUNT] =
+{
+	"receive",
+	"process",
+	"write",
+	"queue",
+	"send",
+	"read",
+	"monitor",
+	"publish",
+	"retrieve",
+	"sdo",
+	"exchange"
+};
+
+static void calibrate(void);
+static unsigned long long monotonic_ns(void);
+
+int prof_get(prof_stat_t* stat_list, int stat_count)
+{
+#ifdef IO_PROFILE
+	int i;
+
+	if(ns_per_tick == 0.0)
+		calibrate();
+
+	if(stat_count > PROF_PHASE_COUNT)
+		stat_count = PROF_PHASE_COUNT;
+
+	/* convert counter ticks to nanoseconds */
+	for(i = 0; i < stat_count; i++)
+	{
+		stat_list[i].count = prof_stat_list[i].count;
+		stat_list[i].min = (unsigned long long)(prof_stat_list[i].min * ns_per_tick);
+		stat_list[i].max = (unsigned long long)(prof_stat_list[i].max * ns_per_tick);
+		stat_list[i].sum = (unsigned long long)(prof_stat_list[i].sum * ns_per_tick);
+		stat_list[i].last = (unsigned long long)(prof_stat_list[i].last * ns_per_tick);
+	}
+
+	return 0;
+#else
+	return 1;
+#endif
+}
+
+int prof_reset(void)
+{
+	memset(prof_stat_list, 0, sizeof(prof_stat_list));
+
+	if(ns_per_tick == 0.0)
+		calibrate();
+
+	return 0;
+}
+
+const char* prof_phase_name(int phase)
+{
+	if(phase < 0 || phase >= PROF_PHASE_COUNT)
+		return NULL;
+
+	return phase_name_list[phase];
+}
+
+static void calibrate(void)
+{
+	prof_tick_t start_tick, end_tick;
+	unsigned long long start_ns, end_ns;
+	struct timespec delay = {0, 10000000};
+
+	start_ns = monotonic_ns();
+	start_tick = prof_read();
+	nanosleep(&delay, NULL);
+	end_tick = prof_read();
+	end_ns = monotonic_ns();
+
+	if(end_tick == start_tick)
+		ns_per_tick = 1.0;
+	else
+		ns_per_tick = (double)(end_ns - start_ns) / (double)(prof_tick_t)(end_tick - start_tick);
+}
+
+static unsigned long long monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
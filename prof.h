@@ -0,0 +1,107 @@
+#ifndef _PROF_H
+#define _PROF_H
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __XENO__
+#include <native/timer.h>
+#endif
+
+/* phase timing of the exchange path
+
+	Built only with IO_PROFILE defined, otherwise the PROF_* macros expand
+	to nothing. Timestamps come from the cheapest counter available:
+	cntvct_el0 on AArch64, PMCCNTR on ARMv7 if IO_PROFILE_PMCCNTR is defined
+	(user access must be enabled by the kernel), the Xenomai TSC otherwise
+	under Xenomai, the TSC on x86 and CLOCK_MONOTONIC otherwise. None of
+	them is a system call that would take an RT task out of primary mode,
+	except CLOCK_MONOTONIC without a vDSO. Statistics are written by the RT task only,
+	so values read by prof_get() from another thread may be one sample off.
+*/
+typedef enum
+{
+	PROF_RECEIVE,
+	PROF_PROCESS,
+	PROF_WRITE,
+	PROF_QUEUE,
+	PROF_SEND,
+	PROF_READ,
+	PROF_MONITOR,
+	PROF_PUBLISH,
+	PROF_RETRIEVE,
+	PROF_SDO,
+	PROF_EXCHANGE,
+	PROF_PHASE_COUNT
+} prof_phase_t;
+
+typedef struct
+{
+	unsigned long long count;
+	unsigned long long min;
+	unsigned long long max;
+	unsigned long long sum;
+	unsigned long long last;
+} prof_stat_t;
+
+#if defined(__arm__) && !defined(__aarch64__) && defined(IO_PROFILE_PMCCNTR)
+typedef uint32_t prof_tick_t;
+#else
+typedef uint64_t prof_tick_t;
+#endif
+
+extern prof_stat_t prof_stat_list[PROF_PHASE_COUNT];
+
+static inline prof_tick_t prof_read(void)
+{
+#if defined(__aarch64__)
+	uint64_t tick;
+	__asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(tick));
+	return tick;
+#elif defined(__arm__) && defined(IO_PROFILE_PMCCNTR)
+	uint32_t tick;
+	__asm__ __volatile__("mrc p15, 0, %0, c9, c13, 0" : "=r"(tick));
+	return tick;
+#elif defined(__XENO__)
+	return rt_timer_tsc();
+#elif defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static inline prof_tick_t prof_mark(prof_tick_t start, int phase)
+{
+	prof_tick_t now = prof_read();
+	prof_tick_t elapsed = now - start;
+	prof_stat_t* stat = &prof_stat_list[phase];
+
+	if(elapsed < stat -> min || stat -> count == 0)
+		stat -> min = elapsed;
+	if(elapsed > stat -> max)
+		stat -> max = elapsed;
+	stat -> sum += elapsed;
+	stat -> last = elapsed;
+	stat -> count++;
+
+	return now;
+}
+
+#ifdef IO_PROFILE
+#define PROF_START(tick) prof_tick_t tick = prof_read()
+#define PROF_RESTART(tick) tick = prof_read()
+#define PROF_MARK(tick, phase) tick = prof_mark(tick, phase)
+#else
+#define PROF_START(tick)
+#define PROF_RESTART(tick)
+#define PROF_MARK(tick, phase)
+#endif
+
+int prof_get(prof_stat_t* stat_list, int stat_count);
+int prof_reset(void);
+const char* prof_phase_name(int phase);
+
+#endif
@@ -0,0 +1,425 @@
+#include "recorder.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+/* the ring holds at least two blocks */
+#define RECORDER_MIN_DEPTH (RECORDER_BLOCK_ROWS * 2)
+#define RECORDER_COLUMN_SIZE 8
+#define RECORDER_IDLE_NS 10000000
+
+/* 0 stopped, 1 armed, 2 while the cycle samples */
+static int state = 0;
+static int stopping = 0;
+static int write_error = 0;
+
+static FILE* file = NULL;
+static pthread_t writer;
+
+static recorder_column_t* column_list = NULL;
+static unsigned int* column_length = NULL;
+static int column_count = 0;
+
+static uint8_t* ring = NULL;
+static size_t row_size = 0;
+static unsigned long long ring_mask = 0;
+static unsigned long long head = 0;
+static unsigned long long tail = 0;
+static unsigned long long dropped = 0;
+static unsigned long long row_total = 0;
+
+static uint8_t* block = NULL;
+static recorder_header_t header;
+
+static void* writer_proc(void* arg);
+static int write_block(int row_count);
+static uint32_t load_value(const uint8_t* data, const recorder_entry_t* entry);
+static int put_varint(uint8_t* data, unsigned long long value);
+static int get_varint(const uint8_t** data, const uint8_t* end, unsigned long long* value);
+static void free_writer(void);
+
+int recorder_start(const char* path, const recorder_column_t* list, int count,
+	int depth, unsigned long long interval)
+{
+	int i;
+	unsigned long long size = RECORDER_MIN_DEPTH;
+
+	if(__atomic_load_n(&state, __ATOMIC_ACQUIRE) != 0 || count <= 0)
+		return 1;
+
+	for(i = 0; i < count; i++)
+	{
+		if(list[i].entry.bit_length == 0 || list[i].entry.bit_length > 32 || list[i].entry.bit_pos > 7)
+			return 1;
+	}
+
+	while(size < (unsigned long long)depth)
+		size <<= 1;
+
+	column_count = count;
+	row_size = sizeof(unsigned long long) + RECORDER_COLUMN_SIZE * count;
+	column_list = (recorder_column_t*)malloc(sizeof(recorder_column_t) * count);
+	column_length = (unsigned int*)malloc(sizeof(unsigned int) * count);
+	ring = (uint8_t*)malloc(row_size * size);
+	block = (uint8_t*)malloc((10 + 5 * count) * RECORDER_BLOCK_ROWS);
+	file = fopen(path, "wb");
+	if(column_list == NULL || column_length == NULL || ring == NULL || block == NULL || file == NULL)
+	{
+		free_writer();
+		return 1;
+	}
+
+	/* the cycle must not fault on the ring */
+	memset(ring, 0, row_size * size);
+	memcpy(column_list, list, sizeof(recorder_column_t) * count);
+	for(i = 0; i < count; i++)
+		column_length[i] = (list[i].entry.bit_pos + list[i].entry.bit_length + 7) / 8;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, RECORDER_MAGIC, sizeof(header.magic));
+	header.version = RECORDER_VERSION;
+	header.column_count = count;
+	header.interval = interval;
+	if(fwrite(&header, sizeof(header), 1, file) != 1)
+	{
+		free_writer();
+		return 1;
+	}
+	for(i = 0; i < count; i++)
+	{
+		if(fwrite(&(list[i].entry), sizeof(recorder_entry_t), 1, file) != 1)
+		{
+			free_writer();
+			return 1;
+		}
+	}
+
+	ring_mask = size - 1;
+	head = 0;
+	tail = 0;
+	dropped = 0;
+	row_total = 0;
+	stopping = 0;
+	write_error = 0;
+
+	if(pthread_create(&writer, NULL, writer_proc, NULL) != 0)
+	{
+		free_writer();
+		return 1;
+	}
+
+	__atomic_store_n(&state, 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+void recorder_sample(unsigned long long cycle)
+{
+	int i;
+	int armed = 1;
+	uint8_t* row;
+	unsigned long long position = head;
+
+	if(__atomic_load_n(&state, __ATOMIC_RELAXED) != 1 ||
+		!__atomic_compare_exchange_n(&state, &armed, 2, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return;
+
+	if(position - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) > ring_mask)
+		dropped++;
+	else
+	{
+		row = ring + (position & ring_mask) * row_size;
+		memcpy(row, &cycle, sizeof(unsigned long long));
+		row += sizeof(unsigned long long);
+		for(i = 0; i < column_count; i++, row += RECORDER_COLUMN_SIZE)
+			memcpy(row, column_list[i].source, column_length[i]);
+
+		__atomic_store_n(&head, position + 1, __ATOMIC_RELEASE);
+	}
+
+	__atomic_store_n(&state, 1, __ATOMIC_RELEASE);
+}
+
+int recorder_stop(void)
+{
+	int armed = 1;
+	int ret;
+	struct timespec wait = {0, 10000};
+
+	/* wait for a sample in progress */
+	while(!__atomic_compare_exchange_n(&state, &armed, 0, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+	{
+		if(armed == 0)
+			return 1;
+		armed = 1;
+		nanosleep(&wait, NULL);
+	}
+
+	__atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+	pthread_join(writer, NULL);
+
+	header.row_count = row_total;
+	header.dropped = dropped;
+	if(fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1)
+		write_error = 1;
+
+	ret = write_error;
+	free_writer();
+
+	return ret;
+}
+
+int recorder_open(recorder_reader_t* reader, const char* path)
+{
+	int i;
+
+	memset(reader, 0, sizeof(recorder_reader_t));
+
+	reader -> file = fopen(path, "rb");
+	if(reader -> file == NULL)
+		return 1;
+
+	if(fread(&(reader -> header), sizeof(recorder_header_t), 1, reader -> file) != 1 ||
+		memcmp(reader -> header.magic, RECORDER_MAGIC, sizeof(reader -> header.magic)) != 0 ||
+		reader -> header.version != RECORDER_VERSION || reader -> header.column_count == 0 ||
+		reader -> header.column_count > 65536)
+	{
+		recorder_close(reader);
+		return 1;
+	}
+
+	reader -> entry_list = (recorder_entry_t*)malloc(sizeof(recorder_entry_t) * reader -> header.column_count);
+	reader -> cycle_list = (unsigned long long*)malloc(sizeof(unsigned long long) * RECORDER_BLOCK_ROWS);
+	reader -> value_list = (uint32_t**)calloc(reader -> header.column_count, sizeof(uint32_t*));
+	if(reader -> entry_list == NULL || reader -> cycle_list == NULL || reader -> value_list == NULL ||
+		fread(reader -> entry_list, sizeof(recorder_entry_t), reader -> header.column_count, reader -> file) !=
+			reader -> header.column_count)
+	{
+		recorder_close(reader);
+		return 1;
+	}
+
+	for(i = 0; i < reader -> header.column_count; i++)
+	{
+		reader -> value_list[i] = (uint32_t*)malloc(sizeof(uint32_t) * RECORDER_BLOCK_ROWS);
+		if(reader -> value_list[i] == NULL || reader -> entry_list[i].bit_length == 0 ||
+			reader -> entry_list[i].bit_length > 32)
+		{
+			recorder_close(reader);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int recorder_read_block(recorder_reader_t* reader)
+{
+	int c, r;
+	uint32_t count[2];
+	uint32_t mask;
+	unsigned long long value;
+	unsigned long long previous;
+	const uint8_t* data;
+	const uint8_t* end;
+
+	reader -> row_count = 0;
+	if(fread(count, sizeof(uint32_t), 2, reader -> file) != 2)
+		return 0;
+	if(count[0] > RECORDER_BLOCK_ROWS)
+		return -1;
+
+	if(count[1] > reader -> block_size)
+	{
+		free(reader -> block);
+		reader -> block = (uint8_t*)malloc(count[1]);
+		reader -> block_size = reader -> block != NULL ? count[1] : 0;
+		if(reader -> block == NULL)
+			return -1;
+	}
+	if(fread(reader -> block, 1, count[1], reader -> file) != count[1])
+		return -1;
+
+	data = reader -> block;
+	end = reader -> block + count[1];
+
+	previous = 0;
+	for(r = 0; r < count[0]; r++)
+	{
+		if(get_varint(&data, end, &value) != 0)
+			return -1;
+		previous += value;
+		reader -> cycle_list[r] = previous;
+	}
+
+	for(c = 0; c < reader -> header.column_count; c++)
+	{
+		mask = reader -> entry_list[c].bit_length == 32 ? 0xffffffffU : (1U << reader -> entry_list[c].bit_length) - 1;
+		previous = 0;
+		for(r = 0; r < count[0]; r++)
+		{
+			if(get_varint(&data, end, &value) != 0)
+				return -1;
+
+			/* undo zigzag, then the difference modulo the entry width */
+			value = (value >> 1) ^ (0 - (value & 1));
+			previous = (previous + value) & mask;
+			reader -> value_list[c][r] = (uint32_t)previous;
+		}
+	}
+
+	reader -> row_count = count[0];
+
+	return count[0];
+}
+
+void recorder_close(recorder_reader_t* reader)
+{
+	int i;
+
+	if(reader -> file != NULL)
+		fclose(reader -> file);
+	if(reader -> value_list != NULL)
+	{
+		for(i = 0; i < reader -> header.column_count; i++)
+			free(reader -> value_list[i]);
+	}
+	free(reader -> value_list);
+	free(reader -> entry_list);
+	free(reader -> cycle_list);
+	free(reader -> block);
+
+	memset(reader, 0, sizeof(recorder_reader_t));
+}
+
+static void* writer_proc(void* arg)
+{
+	int stop;
+	unsigned long long available;
+	struct timespec wait = {0, RECORDER_IDLE_NS};
+
+	(void)arg;
+
+	while(1)
+	{
+		stop = __atomic_load_n(&stopping, __ATOMIC_ACQUIRE);
+		available = __atomic_load_n(&head, __ATOMIC_ACQUIRE) - tail;
+		if(available >= RECORDER_BLOCK_ROWS || (stop && available != 0))
+			write_block(available < RECORDER_BLOCK_ROWS ? (int)available : RECORDER_BLOCK_ROWS);
+		else if(stop)
+			break;
+		else
+			nanosleep(&wait, NULL);
+	}
+
+	return NULL;
+}
+
+static int write_block(int row_count)
+{
+	int c, r;
+	uint32_t count[2];
+	uint32_t value, sample, mask, half;
+	long long step;
+	unsigned long long cycle, previous;
+	const uint8_t* row;
+	uint8_t* data = block;
+
+	/* the cycle column */
+	previous = 0;
+	for(r = 0; r < row_count; r++)
+	{
+		row = ring + ((tail + r) & ring_mask) * row_size;
+		memcpy(&cycle, row, sizeof(unsigned long long));
+		data += put_varint(data, cycle - previous);
+		previous = cycle;
+	}
+
+	/* differences modulo the width, sign extended and zigzag encoded */
+	for(c = 0; c < column_count; c++)
+	{
+		mask = column_list[c].entry.bit_length == 32 ? 0xffffffffU : (1U << column_list[c].entry.bit_length) - 1;
+		half = 1U << (column_list[c].entry.bit_length - 1);
+		value = 0;
+		for(r = 0; r < row_count; r++)
+		{
+			row = ring + ((tail + r) & ring_mask) * row_size + sizeof(unsigned long long) + RECORDER_COLUMN_SIZE * c;
+			sample = load_value(row, &(column_list[c].entry));
+			step = (long long)(((sample - value) & mask) ^ half) - (long long)half;
+			value = sample;
+
+			data += put_varint(data, ((unsigned long long)step << 1) ^ (unsigned long long)(step >> 63));
+		}
+	}
+
+	count[0] = row_count;
+	count[1] = data - block;
+	if(fwrite(count, sizeof(uint32_t), 2, file) != 2 || fwrite(block, 1, count[1], file) != count[1])
+		write_error = 1;
+
+	row_total += row_count;
+	__atomic_store_n(&tail, tail + row_count, __ATOMIC_RELEASE);
+
+	return write_error;
+}
+
+/* entries are little endian on the bus */
+static uint32_t load_value(const uint8_t* data, const recorder_entry_t* entry)
+{
+	int i;
+	unsigned long long value = 0;
+
+	for(i = 0; i < (entry -> bit_pos + entry -> bit_length + 7) / 8; i++)
+		value |= (unsigned long long)data[i] << (8 * i);
+
+	value >>= entry -> bit_pos;
+	return entry -> bit_length == 32 ? (uint32_t)value : (uint32_t)value & ((1U << entry -> bit_length) - 1);
+}
+
+static int put_varint(uint8_t* data, unsigned long long value)
+{
+	int length = 0;
+
+	while(value >= 0x80)
+	{
+		data[length++] = (uint8_t)value | 0x80;
+		value >>= 7;
+	}
+	data[length++] = (uint8_t)value;
+
+	return length;
+}
+
+static int get_varint(const uint8_t** data, const uint8_t* end, unsigned long long* value)
+{
+	int shift;
+
+	*value = 0;
+	for(shift = 0; shift < 64 && *data < end; shift += 7)
+	{
+		*value |= (unsigned long long)(**data & 0x7f) << shift;
+		if(*((*data)++) < 0x80)
+			return 0;
+	}
+
+	return 1;
+}
+
+static void free_writer(void)
+{
+	if(file != NULL)
+		fclose(file);
+	free(column_list);
+	free(column_length);
+	free(ring);
+	free(block);
+
+	file = NULL;
+	column_list = NULL;
+	column_length = NULL;
+	ring = NULL;
+	block = NULL;
+	column_count = 0;
+}
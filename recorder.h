@@ -0,0 +1,78 @@
+#ifndef _RECORDER_H
+#define _RECORDER_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* process data recorder
+
+	recorder_sample() copies the selected entries of the cycle into a row of
+	a preallocated single producer, single consumer ring : one bounded copy
+	per entry and no system call. A full ring drops the row and counts it.
+	A writer thread drains the ring and writes blocks of up to
+	RECORDER_BLOCK_ROWS rows to the file, column by column : the cycle
+	count, then every entry. A column stores the difference to the previous
+	row (modulo the entry width, the first row of a block against 0),
+	zigzag and varint encoded, so slowly changing positions and constant
+	status words take one or two bytes per sample.
+
+	file : recorder_header_t, column_count recorder_entry_t, then blocks of
+	uint32_t row count, uint32_t byte size and the encoded columns, all in
+	host byte order. row_count and dropped are written when recording stops.
+*/
+#define RECORDER_MAGIC "IORECORD"
+#define RECORDER_VERSION 1
+#define RECORDER_BLOCK_ROWS 1024
+
+typedef struct
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t column_count;
+	uint64_t interval;
+	uint64_t row_count;
+	uint64_t dropped;
+} recorder_header_t;
+
+typedef struct
+{
+	uint16_t slave;
+	uint16_t index;
+	uint8_t subindex;
+	uint8_t direction;
+	uint8_t bit_pos;
+	uint8_t bit_length;
+} recorder_entry_t;
+
+/* an entry and where the cycle finds it, at most 32 bits wide */
+typedef struct
+{
+	recorder_entry_t entry;
+	const uint8_t* source;
+} recorder_column_t;
+
+/* writer, recorder_sample() runs in the cycle */
+int recorder_start(const char* path, const recorder_column_t* column_list, int column_count,
+	int depth, unsigned long long interval);
+void recorder_sample(unsigned long long cycle);
+int recorder_stop(void);
+
+/* reader, every block is decoded into cycle_list and value_list[column][row] */
+typedef struct
+{
+	FILE* file;
+	recorder_header_t header;
+	recorder_entry_t* entry_list;
+
+	int row_count;
+	unsigned long long* cycle_list;
+	uint32_t** value_list;
+	uint8_t* block;
+	uint32_t block_size;
+} recorder_reader_t;
+
+int recorder_open(recorder_reader_t* reader, const char* path);
+int recorder_read_block(recorder_reader_t* reader);
+void recorder_close(recorder_reader_t* reader);
+
+#endif
@@ -0,0 +1,306 @@
+#include "sdo.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* bounded multi-producer, multi-consumer queue
+
+	The sequence of a cell is pos while it is free for the producer at
+	position pos and pos + 1 once it holds the item for the consumer at
+	pos. Producers and consumers claim positions with a CAS on head and
+	tail, which only fails when another thread on the same side won, so the
+	cycle, sole consumer of one queue and sole producer of the other, never
+	loops.
+*/
+typedef struct
+{
+	uint32_t sequence;
+	sdo_channel_t* channel;
+} sdo_cell_t;
+
+typedef struct
+{
+	sdo_cell_t* cell_list;
+	uint32_t mask;
+	uint32_t head;
+	uint32_t tail;
+} sdo_queue_t;
+
+static sdo_channel_t* channel_list = NULL;
+static int channel_count = 0;
+
+static sdo_queue_t submit_queue;
+static sdo_queue_t complete_queue;
+
+/* running transfers, only touched by the cycle */
+static sdo_channel_t** active_list = NULL;
+static int active_count = 0;
+static int poll_next = 0;
+
+static int queue_init(sdo_queue_t* queue, int size);
+static void queue_free(sdo_queue_t* queue);
+static int queue_push(sdo_queue_t* queue, sdo_channel_t* channel);
+static sdo_channel_t* queue_pop(sdo_queue_t* queue);
+static void start_transfer(sdo_channel_t* channel);
+static void finish_transfer(sdo_channel_t* channel, ec_request_state_t state);
+
+int sdo_channel_init(sdo_channel_t* channel, ec_slave_config_t* config)
+{
+	int i;
+	static const size_t size_list[SDO_REQUEST_COUNT] = {4, 1, 2, 4};
+
+	memset(channel, 0, sizeof(sdo_channel_t));
+	for(i = 0; i < SDO_REQUEST_COUNT; i++)
+	{
+		channel -> request_list[i] = ecrt_slave_config_create_sdo_request(config, 0, 0, size_list[i]);
+		if(channel -> request_list[i] == NULL)
+			return 1;
+		ecrt_sdo_request_timeout(channel -> request_list[i], SDO_TIMEOUT_MS);
+	}
+
+	return 0;
+}
+
+int sdo_init(sdo_channel_t* list, int count)
+{
+	if(channel_list != NULL || count <= 0)
+		return 1;
+
+	active_list = (sdo_channel_t**)malloc(sizeof(sdo_channel_t*) * count);
+	if(active_list == NULL || queue_init(&submit_queue, count) != 0 || queue_init(&complete_queue, count) != 0)
+	{
+		sdo_free();
+		return 1;
+	}
+
+	channel_list = list;
+	channel_count = count;
+	active_count = 0;
+	poll_next = 0;
+
+	return 0;
+}
+
+void sdo_free(void)
+{
+	/* the requests are released with the master */
+	queue_free(&submit_queue);
+	queue_free(&complete_queue);
+	free(active_list);
+	active_list = NULL;
+	channel_list = NULL;
+	channel_count = 0;
+	active_count = 0;
+}
+
+int sdo_submit(int channel, io_sdo_t* sdo)
+{
+	int busy = 0;
+	sdo_channel_t* target;
+
+	if(channel_list == NULL || channel < 0 || channel >= channel_count ||
+		sdo -> index < 0 || sdo -> index > 0xffff || sdo -> subindex < 0 || sdo -> subindex > 0xff ||
+		(sdo -> direction == 0 && sdo -> size != 1 && sdo -> size != 2 && sdo -> size != 4))
+		return 1;
+
+	target = &channel_list[channel];
+	if(!__atomic_compare_exchange_n(&(target -> busy), &busy, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return 1;
+
+	sdo -> state = IO_SDO_PENDING;
+	target -> sdo = sdo;
+
+	/* cannot fail, every channel holds at most one cell */
+	return queue_push(&submit_queue, target);
+}
+
+int sdo_complete(io_sdo_t** sdo)
+{
+	sdo_channel_t* channel;
+
+	if(channel_list == NULL)
+		return 1;
+
+	channel = queue_pop(&complete_queue);
+	if(channel == NULL)
+		return 1;
+
+	*sdo = channel -> sdo;
+	channel -> sdo = NULL;
+	__atomic_store_n(&(channel -> busy), 0, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+void sdo_service(void)
+{
+	int i;
+	int count;
+	sdo_channel_t* channel;
+	ec_request_state_t state;
+
+	if(channel_list == NULL)
+		return;
+
+	/* finished transfers leave the list, the next one takes their place */
+	count = active_count < SDO_POLL_BUDGET ? active_count : SDO_POLL_BUDGET;
+	for(i = 0; i < count; i++)
+	{
+		if(poll_next >= active_count)
+			poll_next = 0;
+
+		channel = active_list[poll_next];
+		state = ecrt_sdo_request_state(channel -> request);
+		if(state == EC_REQUEST_BUSY)
+		{
+			poll_next++;
+			continue;
+		}
+
+		active_list[poll_next] = active_list[--active_count];
+		finish_transfer(channel, state);
+	}
+
+	for(i = 0; i < SDO_START_BUDGET; i++)
+	{
+		channel = queue_pop(&submit_queue);
+		if(channel == NULL)
+			break;
+		start_transfer(channel);
+	}
+}
+
+static void start_transfer(sdo_channel_t* channel)
+{
+	io_sdo_t* sdo = channel -> sdo;
+	ec_sdo_request_t* request;
+
+	if(sdo -> direction != 0)
+	{
+		request = channel -> request_list[0];
+		ecrt_sdo_request_index(request, sdo -> index, sdo -> subindex);
+		ecrt_sdo_request_read(request);
+	}
+	else
+	{
+		request = channel -> request_list[sdo -> size == 4 ? 3 : sdo -> size];
+		ecrt_sdo_request_index(request, sdo -> index, sdo -> subindex);
+		switch(sdo -> size)
+		{
+			case 1 : EC_WRITE_U8(ecrt_sdo_request_data(request), sdo -> value); break;
+			case 2 : EC_WRITE_U16(ecrt_sdo_request_data(request), sdo -> value); break;
+			default : EC_WRITE_U32(ecrt_sdo_request_data(request), sdo -> value); break;
+		}
+		ecrt_sdo_request_write(request);
+	}
+
+	channel -> request = request;
+	active_list[active_count++] = channel;
+}
+
+static void finish_transfer(sdo_channel_t* channel, ec_request_state_t state)
+{
+	io_sdo_t* sdo = channel -> sdo;
+	uint8_t* data = ecrt_sdo_request_data(channel -> request);
+	int result = state == EC_REQUEST_SUCCESS ? IO_SDO_DONE : IO_SDO_ERROR;
+
+	if(result == IO_SDO_DONE && sdo -> direction != 0)
+	{
+		sdo -> size = ecrt_sdo_request_data_size(channel -> request);
+		switch(sdo -> size)
+		{
+			case 1 : sdo -> value = EC_READ_U8(data); break;
+			case 2 : sdo -> value = EC_READ_U16(data); break;
+			case 4 : sdo -> value = EC_READ_U32(data); break;
+			default : result = IO_SDO_ERROR; break;
+		}
+	}
+
+	__atomic_store_n(&(sdo -> state), result, __ATOMIC_RELEASE);
+	queue_push(&complete_queue, channel);
+}
+
+static int queue_init(sdo_queue_t* queue, int size)
+{
+	uint32_t i;
+	uint32_t cell_count = 1;
+
+	while(cell_count < (uint32_t)size)
+		cell_count <<= 1;
+
+	queue -> cell_list = (sdo_cell_t*)malloc(sizeof(sdo_cell_t) * cell_count);
+	if(queue -> cell_list == NULL)
+		return 1;
+
+	for(i = 0; i < cell_count; i++)
+	{
+		queue -> cell_list[i].sequence = i;
+		queue -> cell_list[i].channel = NULL;
+	}
+	queue -> mask = cell_count - 1;
+	queue -> head = 0;
+	queue -> tail = 0;
+
+	return 0;
+}
+
+static void queue_free(sdo_queue_t* queue)
+{
+	free(queue -> cell_list);
+	memset(queue, 0, sizeof(sdo_queue_t));
+}
+
+static int queue_push(sdo_queue_t* queue, sdo_channel_t* channel)
+{
+	sdo_cell_t* cell;
+	uint32_t pos = __atomic_load_n(&(queue -> head), __ATOMIC_RELAXED);
+	int32_t diff;
+
+	for(;;)
+	{
+		cell = &(queue -> cell_list[pos & queue -> mask]);
+		diff = (int32_t)(__atomic_load_n(&(cell -> sequence), __ATOMIC_ACQUIRE) - pos);
+		if(diff == 0)
+		{
+			if(__atomic_compare_exchange_n(&(queue -> head), &pos, pos + 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if(diff < 0)
+			return 1;
+		else
+			pos = __atomic_load_n(&(queue -> head), __ATOMIC_RELAXED);
+	}
+
+	cell -> channel = channel;
+	__atomic_store_n(&(cell -> sequence), pos + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+static sdo_channel_t* queue_pop(sdo_queue_t* queue)
+{
+	sdo_cell_t* cell;
+	sdo_channel_t* channel;
+	uint32_t pos = __atomic_load_n(&(queue -> tail), __ATOMIC_RELAXED);
+	int32_t diff;
+
+	for(;;)
+	{
+		cell = &(queue -> cell_list[pos & queue -> mask]);
+		diff = (int32_t)(__atomic_load_n(&(cell -> sequence), __ATOMIC_ACQUIRE) - (pos + 1));
+		if(diff == 0)
+		{
+			if(__atomic_compare_exchange_n(&(queue -> tail), &pos, pos + 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if(diff < 0)
+			return NULL;
+		else
+			pos = __atomic_load_n(&(queue -> tail), __ATOMIC_RELAXED);
+	}
+
+	channel = cell -> channel;
+	__atomic_store_n(&(cell -> sequence), pos + queue -> mask + 1, __ATOMIC_RELEASE);
+
+	return channel;
+}
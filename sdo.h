@@ -0,0 +1,46 @@
+#ifndef _SDO_H
+#define _SDO_H
+
+#include <stdint.h>
+
+#include "ecrt.h"
+#include "io.h"
+
+/* asynchronous SDO transfers
+
+	A channel (one per CiA402 node) owns SDO requests created before
+	activation : one for reads and one per write size, as a request sends
+	the data size it was created with. sdo_submit() hands a transfer to the
+	cycle through a bounded lock-free queue from any thread. sdo_service()
+	runs in the cycle : it polls at most SDO_POLL_BUDGET running transfers,
+	starts at most SDO_START_BUDGET new ones and puts finished transfers on
+	a second queue that sdo_complete() empties. A channel runs one transfer
+	at a time and accepts the next one only once the previous was collected,
+	so neither queue can fill up and the cycle never waits or retries.
+*/
+#define SDO_POLL_BUDGET 4
+#define SDO_START_BUDGET 2
+#define SDO_TIMEOUT_MS 1000
+
+/* read, 8, 16 and 32 bit writes */
+#define SDO_REQUEST_COUNT 4
+
+typedef struct
+{
+	ec_sdo_request_t* request_list[SDO_REQUEST_COUNT];
+
+	/* owned by the submitter from sdo_submit() until sdo_complete() */
+	int busy;
+	io_sdo_t* sdo;
+	ec_sdo_request_t* request;
+} sdo_channel_t;
+
+int sdo_channel_init(sdo_channel_t* channel, ec_slave_config_t* config);
+int sdo_init(sdo_channel_t* channel_list, int channel_count);
+void sdo_free(void);
+
+int sdo_submit(int channel, io_sdo_t* sdo);
+int sdo_complete(io_sdo_t** sdo);
+void sdo_service(void);
+
+#endif
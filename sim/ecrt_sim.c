@@ -0,0 +1,1343 @@
+#include "ecrt_sim.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ecrt.h"
+
+#define SIM_MAX_SYNCS 8
+#define SIM_DEFAULT_INTERVAL 1000000
+
+/* CiA402 objects used by the drive model */
+#define OBJ_CONTROL_WORD 0x6040
+#define OBJ_STATUS_WORD 0x6041
+#define OBJ_MODE 0x6060
+#define OBJ_MODE_DISPLAY 0x6061
+#define OBJ_ACTUAL_POSITION 0x6064
+#define OBJ_ACTUAL_VELOCITY 0x606c
+#define OBJ_TARGET_TORQUE 0x6071
+#define OBJ_ACTUAL_TORQUE 0x6077
+#define OBJ_TARGET_POSITION 0x607a
+#define OBJ_FOLLOWING_ERROR 0x60f4
+#define OBJ_TARGET_VELOCITY 0x60ff
+#define OBJ_ERROR_CODE 0x603f
+#define OBJ_FOLLOWING_ERROR_WINDOW 0x6065
+#define OBJ_MAX_TORQUE 0x6072
+
+/* bus cycles an SDO transfer takes through the mailbox */
+#define SIM_SDO_CYCLES 4
+
+#define STATE_SWITCH_ON_DISABLED 0x40
+#define STATE_READY_TO_SWITCH_ON 0x21
+#define STATE_SWITCHED_ON 0x23
+#define STATE_OPERATION_ENABLED 0x27
+#define STATE_FAULT 0x08
+#define SW_VOLTAGE_ENABLED 0x10
+
+typedef struct
+{
+	uint16_t index;
+	uint8_t subindex;
+	uint8_t bit_length;
+	int64_t value;
+} sim_object_t;
+
+typedef struct
+{
+	ec_slave_info_t info;
+	int model;
+
+	ec_sync_info_t sync_list[SIM_MAX_SYNCS];
+	sim_object_t* object_list;
+	int object_count;
+
+	int state;
+	int last_control_word;
+
+	/* set by ecrt_sim_set_slave_state(), the slave drops off the bus */
+	int offline;
+} sim_slave_t;
+
+struct ec_sdo_request
+{
+	ec_slave_config_t* config;
+	ec_sdo_request_t* next;
+
+	uint16_t index;
+	uint8_t subindex;
+	uint8_t* data;
+	size_t size;
+	size_t data_size;
+	uint32_t timeout;
+
+	int write;
+	ec_request_state_t state;
+	unsigned long long due_cycle;
+};
+
+struct ec_slave_config
+{
+	sim_slave_t* slave;
+	ec_sync_info_t sync_list[SIM_MAX_SYNCS];
+	ec_sdo_request_t* sdo_request_list;
+	ec_domain_t* sync_domain[SIM_MAX_SYNCS];
+
+	uint16_t dc_assign_activate;
+	uint32_t dc_sync0_cycle;
+	int32_t dc_sync0_shift;
+};
+
+typedef struct
+{
+	ec_slave_config_t* config;
+	int sync;
+	unsigned int offset;
+	unsigned int size;
+} sim_region_t;
+
+struct ec_domain
+{
+	sim_region_t* region_list;
+	int region_count;
+
+	size_t size;
+	uint8_t* data;
+
+	int queued;
+	int in_flight;
+	unsigned int expected_wc;
+	unsigned int received_wc;
+	unsigned int working_counter;
+};
+
+struct ec_master
+{
+	int active;
+	size_t send_interval;
+	uint64_t app_time;
+
+	ec_domain_t** domain_list;
+	int domain_count;
+	ec_slave_config_t** config_list;
+
+	ec_slave_config_t* reference_clock;
+	uint64_t reference_time;
+	uint64_t latched_time;
+	int64_t drift_residue;
+};
+
+static sim_slave_t* slave_list = NULL;
+static int slave_count = 0;
+static int devices_enabled = 1;
+static int dc_drift_ppb = 0;
+static unsigned long long bus_cycle = 0;
+static int sdo_busy_count = 0;
+
+static ec_master_t* sim_master = NULL;
+
+static int copy_sync_list(ec_sync_info_t* dst, const ec_sync_info_t* src, unsigned int sync_count);
+static void free_sync_list(ec_sync_info_t* sync_list);
+static int add_object(sim_slave_t* slave, const ec_pdo_entry_info_t* entry);
+static sim_object_t* find_object(sim_slave_t* slave, uint16_t index, uint8_t subindex);
+static int64_t read_bits(const uint8_t* data, unsigned int bit_offset, unsigned int bit_length);
+static void write_bits(uint8_t* data, unsigned int bit_offset, unsigned int bit_length, int64_t value);
+static unsigned int sync_bit_length(const ec_sync_info_t* sync);
+static void transfer_region(ec_domain_t* domain, sim_region_t* region, int to_objects);
+static void run_cia402(sim_slave_t* slave, size_t interval);
+static void run_digital_input(sim_slave_t* slave);
+static void free_config(ec_slave_config_t* config);
+static unsigned int region_wc(const sim_region_t* region);
+static void run_sdo(ec_sdo_request_t* req);
+
+/* topology */
+
+int ecrt_sim_reset(void)
+{
+	int i;
+
+	if(sim_master != NULL)
+		return 1;
+
+	for(i = 0; i < slave_count; i++)
+	{
+		free_sync_list(slave_list[i].sync_list);
+		free(slave_list[i].object_list);
+	}
+	free(slave_list);
+
+	slave_list = NULL;
+	slave_count = 0;
+	bus_cycle = 0;
+
+	return 0;
+}
+
+int ecrt_sim_add_slave(uint32_t vendor_id, uint32_t product_code, const char* name, int model,
+	const ec_sync_info_t* sync_list, unsigned int sync_count)
+{
+	unsigned int i, j, k;
+	sim_slave_t* slave;
+	sim_slave_t* new_list;
+
+	if(sim_master != NULL || sync_count > SIM_MAX_SYNCS)
+		return 1;
+
+	new_list = (sim_slave_t*)realloc(slave_list, sizeof(sim_slave_t) * (slave_count + 1));
+	if(new_list == NULL)
+		return 1;
+	slave_list = new_list;
+
+	slave = &slave_list[slave_count];
+	memset(slave, 0, sizeof(sim_slave_t));
+
+	slave -> info.position = slave_count;
+	slave -> info.vendor_id = vendor_id;
+	slave -> info.product_code = product_code;
+	slave -> info.al_state = 0x02;
+	slave -> info.sync_count = sync_count;
+	strncpy(slave -> info.name, name, EC_MAX_STRING_LENGTH - 1);
+	slave -> model = model;
+	slave -> state = STATE_SWITCH_ON_DISABLED;
+
+	if(copy_sync_list(slave -> sync_list, sync_list, sync_count) != 0)
+		return 1;
+
+	for(i = 0; i < sync_count; i++)
+	{
+		for(j = 0; j < sync_list[i].n_pdos; j++)
+		{
+			for(k = 0; k < sync_list[i].pdos[j].n_entries; k++)
+			{
+				if(add_object(slave, &(sync_list[i].pdos[j].entries[k])) != 0)
+					return 1;
+			}
+		}
+	}
+
+	slave_count++;
+
+	return 0;
+}
+
+int ecrt_sim_add_cia402(int count)
+{
+	int i, j;
+
+	static ec_pdo_entry_info_t output_entries[] =
+	{
+		{OBJ_CONTROL_WORD, 0x00, 16},
+		{OBJ_TARGET_POSITION, 0x00, 32},
+		{OBJ_MODE, 0x00, 8},
+		{OBJ_TARGET_VELOCITY, 0x00, 32},
+		{OBJ_TARGET_TORQUE, 0x00, 16}
+	};
+	static ec_pdo_entry_info_t input_entries[] =
+	{
+		{OBJ_STATUS_WORD, 0x00, 16},
+		{OBJ_ACTUAL_POSITION, 0x00, 32},
+		{OBJ_MODE_DISPLAY, 0x00, 8},
+		{OBJ_ACTUAL_VELOCITY, 0x00, 32},
+		{OBJ_ACTUAL_TORQUE, 0x00, 16},
+		{OBJ_FOLLOWING_ERROR, 0x00, 32}
+	};
+	static ec_pdo_info_t output_pdos[] = {{0x1600, 5, output_entries}};
+	static ec_pdo_info_t input_pdos[] = {{0x1a00, 6, input_entries}};
+	static ec_sync_info_t syncs[] =
+	{
+		{0, EC_DIR_OUTPUT, 0, NULL, EC_WD_DISABLE},
+		{1, EC_DIR_INPUT, 0, NULL, EC_WD_DISABLE},
+		{2, EC_DIR_OUTPUT, 1, output_pdos, EC_WD_ENABLE},
+		{3, EC_DIR_INPUT, 1, input_pdos, EC_WD_DISABLE}
+	};
+
+	/* reachable by SDO only */
+	static ec_pdo_entry_info_t sdo_entries[] =
+	{
+		{OBJ_ERROR_CODE, 0x00, 16},
+		{OBJ_FOLLOWING_ERROR_WINDOW, 0x00, 32},
+		{OBJ_MAX_TORQUE, 0x00, 16}
+	};
+
+	for(i = 0; i < count; i++)
+	{
+		if(ecrt_sim_add_slave(ECRT_SIM_VENDOR_ID, ECRT_SIM_CIA402_CODE, "Simulated CiA402 drive",
+			ECRT_SIM_CIA402, syncs, 4) != 0)
+			return 1;
+
+		for(j = 0; j < (int)(sizeof(sdo_entries) / sizeof(sdo_entries[0])); j++)
+		{
+			if(add_object(&slave_list[slave_count - 1], &sdo_entries[j]) != 0)
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+int ecrt_sim_add_digital_input(int count, int bit_count)
+{
+	int i, ret = 0;
+	ec_pdo_entry_info_t* entries;
+	ec_pdo_info_t* pdos;
+	ec_sync_info_t sync;
+
+	entries = (ec_pdo_entry_info_t*)malloc(sizeof(ec_pdo_entry_info_t) * bit_count);
+	pdos = (ec_pdo_info_t*)malloc(sizeof(ec_pdo_info_t) * bit_count);
+	if(entries == NULL || pdos == NULL)
+	{
+		free(entries);
+		free(pdos);
+		return 1;
+	}
+
+	/* one PDO with one bit per channel */
+	for(i = 0; i < bit_count; i++)
+	{
+		entries[i].index = 0x6000 + i * 0x10;
+		entries[i].subindex = 0x01;
+		entries[i].bit_length = 1;
+		pdos[i].index = 0x1a00 + i;
+		pdos[i].n_entries = 1;
+		pdos[i].entries = &entries[i];
+	}
+
+	sync.index = 0;
+	sync.dir = EC_DIR_INPUT;
+	sync.n_pdos = bit_count;
+	sync.pdos = pdos;
+	sync.watchdog_mode = EC_WD_DISABLE;
+
+	for(i = 0; i < count && ret == 0; i++)
+		ret = ecrt_sim_add_slave(ECRT_SIM_VENDOR_ID, ECRT_SIM_DI_CODE, "Simulated digital input",
+			ECRT_SIM_GENERIC, &sync, 1);
+
+	free(entries);
+	free(pdos);
+
+	return ret;
+}
+
+int ecrt_sim_add_digital_output(int count, int bit_count)
+{
+	int i, ret = 0;
+	ec_pdo_entry_info_t* entries;
+	ec_pdo_info_t* pdos;
+	ec_sync_info_t sync;
+
+	entries = (ec_pdo_entry_info_t*)malloc(sizeof(ec_pdo_entry_info_t) * bit_count);
+	pdos = (ec_pdo_info_t*)malloc(sizeof(ec_pdo_info_t) * bit_count);
+	if(entries == NULL || pdos == NULL)
+	{
+		free(entries);
+		free(pdos);
+		return 1;
+	}
+
+	for(i = 0; i < bit_count; i++)
+	{
+		entries[i].index = 0x7000 + i * 0x10;
+		entries[i].subindex = 0x01;
+		entries[i].bit_length = 1;
+		pdos[i].index = 0x1600 + i;
+		pdos[i].n_entries = 1;
+		pdos[i].entries = &entries[i];
+	}
+
+	sync.index = 0;
+	sync.dir = EC_DIR_OUTPUT;
+	sync.n_pdos = bit_count;
+	sync.pdos = pdos;
+	sync.watchdog_mode = EC_WD_ENABLE;
+
+	for(i = 0; i < count && ret == 0; i++)
+		ret = ecrt_sim_add_slave(ECRT_SIM_VENDOR_ID, ECRT_SIM_DO_CODE, "Simulated digital output",
+			ECRT_SIM_GENERIC, &sync, 1);
+
+	free(entries);
+	free(pdos);
+
+	return ret;
+}
+
+int ecrt_sim_slave_count(void)
+{
+	return slave_count;
+}
+
+int ecrt_sim_set_devices(int enable)
+{
+	devices_enabled = enable;
+	return 0;
+}
+
+int ecrt_sim_set_dc_drift(int drift_ppb)
+{
+	dc_drift_ppb = drift_ppb;
+	return 0;
+}
+
+int ecrt_sim_read_object(int position, uint16_t index, uint8_t subindex, int64_t* value)
+{
+	sim_object_t* object;
+
+	if(position < 0 || position >= slave_count)
+		return 1;
+
+	object = find_object(&slave_list[position], index, subindex);
+	if(object == NULL)
+		return 1;
+
+	*value = object -> value;
+	return 0;
+}
+
+int ecrt_sim_write_object(int position, uint16_t index, uint8_t subindex, int64_t value)
+{
+	sim_object_t* object;
+
+	if(position < 0 || position >= slave_count)
+		return 1;
+
+	object = find_object(&slave_list[position], index, subindex);
+	if(object == NULL)
+		return 1;
+
+	object -> value = value;
+	return 0;
+}
+
+int ecrt_sim_set_slave_state(int position, int al_state)
+{
+	if(position < 0 || position >= slave_count || al_state < 0 || al_state > 0x0f)
+		return 1;
+
+	slave_list[position].offline = al_state == 0;
+	if(al_state != 0)
+		slave_list[position].info.al_state = al_state;
+
+	return 0;
+}
+
+/* master */
+
+ec_master_t* ecrt_request_master(unsigned int master_index)
+{
+	if(master_index != 0 || sim_master != NULL)
+		return NULL;
+
+	sim_master = (ec_master_t*)calloc(1, sizeof(ec_master_t));
+	if(sim_master == NULL)
+		return NULL;
+
+	sim_master -> config_list = (ec_slave_config_t**)calloc(slave_count + 1, sizeof(ec_slave_config_t*));
+	if(sim_master -> config_list == NULL)
+	{
+		free(sim_master);
+		sim_master = NULL;
+		return NULL;
+	}
+
+	return sim_master;
+}
+
+void ecrt_release_master(ec_master_t* master)
+{
+	int i;
+
+	for(i = 0; i < master -> domain_count; i++)
+	{
+		free(master -> domain_list[i] -> region_list);
+		free(master -> domain_list[i] -> data);
+		free(master -> domain_list[i]);
+	}
+	free(master -> domain_list);
+
+	for(i = 0; i < slave_count; i++)
+	{
+		if(master -> config_list[i] != NULL)
+			free_config(master -> config_list[i]);
+		slave_list[i].info.al_state = 0x02;
+		slave_list[i].state = STATE_SWITCH_ON_DISABLED;
+		slave_list[i].offline = 0;
+	}
+	free(master -> config_list);
+
+	free(master);
+	sim_master = NULL;
+}
+
+ec_domain_t* ecrt_master_create_domain(ec_master_t* master)
+{
+	ec_domain_t* domain;
+	ec_domain_t** new_list;
+
+	if(master -> active)
+		return NULL;
+
+	new_list = (ec_domain_t**)realloc(master -> domain_list, sizeof(ec_domain_t*) * (master -> domain_count + 1));
+	if(new_list == NULL)
+		return NULL;
+	master -> domain_list = new_list;
+
+	domain = (ec_domain_t*)calloc(1, sizeof(ec_domain_t));
+	if(domain == NULL)
+		return NULL;
+
+	master -> domain_list[master -> domain_count++] = domain;
+
+	return domain;
+}
+
+ec_slave_config_t* ecrt_master_slave_config(ec_master_t* master, uint16_t alias, uint16_t position,
+	uint32_t vendor_id, uint32_t product_code)
+{
+	ec_slave_config_t* config;
+	sim_slave_t* slave;
+
+	if(master -> active || alias != 0 || position >= slave_count)
+		return NULL;
+
+	slave = &slave_list[position];
+	if(slave -> info.vendor_id != vendor_id || slave -> info.product_code != product_code)
+		return NULL;
+
+	if(master -> config_list[position] != NULL)
+		return master -> config_list[position];
+
+	config = (ec_slave_config_t*)calloc(1, sizeof(ec_slave_config_t));
+	if(config == NULL)
+		return NULL;
+
+	config -> slave = slave;
+	if(copy_sync_list(config -> sync_list, slave -> sync_list, slave -> info.sync_count) != 0)
+	{
+		free(config);
+		return NULL;
+	}
+
+	master -> config_list[position] = config;
+
+	return config;
+}
+
+int ecrt_master_select_reference_clock(ec_master_t* master, ec_slave_config_t* sc)
+{
+	if(master -> active)
+		return -EBUSY;
+
+	master -> reference_clock = sc;
+	return 0;
+}
+
+int ecrt_master(ec_master_t* master, ec_master_info_t* master_info)
+{
+	memset(master_info, 0, sizeof(ec_master_info_t));
+	master_info -> slave_count = slave_count;
+	master_info -> link_up = 1;
+	master_info -> app_time = master -> app_time;
+
+	return 0;
+}
+
+int ecrt_master_get_slave(ec_master_t* master, uint16_t slave_position, ec_slave_info_t* slave_info)
+{
+	if(slave_position >= slave_count)
+		return -EINVAL;
+
+	*slave_info = slave_list[slave_position].info;
+
+	return 0;
+}
+
+int ecrt_master_get_sync_manager(ec_master_t* master, uint16_t slave_position, uint8_t sync_index,
+	ec_sync_info_t* sync)
+{
+	if(slave_position >= slave_count || sync_index >= slave_list[slave_position].info.sync_count)
+		return -EINVAL;
+
+	*sync = slave_list[slave_position].sync_list[sync_index];
+	sync -> pdos = NULL;
+
+	return 0;
+}
+
+int ecrt_master_get_pdo(ec_master_t* master, uint16_t slave_position, uint8_t sync_index,
+	uint16_t pos, ec_pdo_info_t* pdo)
+{
+	ec_sync_info_t* sync;
+
+	if(slave_position >= slave_count || sync_index >= slave_list[slave_position].info.sync_count)
+		return -EINVAL;
+
+	sync = &(slave_list[slave_position].sync_list[sync_index]);
+	if(pos >= sync -> n_pdos)
+		return -EINVAL;
+
+	*pdo = sync -> pdos[pos];
+	pdo -> entries = NULL;
+
+	return 0;
+}
+
+int ecrt_master_get_pdo_entry(ec_master_t* master, uint16_t slave_position, uint8_t sync_index,
+	uint16_t pdo_pos, uint16_t entry_pos, ec_pdo_entry_info_t* entry)
+{
+	ec_sync_info_t* sync;
+
+	if(slave_position >= slave_count || sync_index >= slave_list[slave_position].info.sync_count)
+		return -EINVAL;
+
+	sync = &(slave_list[slave_position].sync_list[sync_index]);
+	if(pdo_pos >= sync -> n_pdos || entry_pos >= sync -> pdos[pdo_pos].n_entries)
+		return -EINVAL;
+
+	*entry = sync -> pdos[pdo_pos].entries[entry_pos];
+
+	return 0;
+}
+
+int ecrt_master_set_send_interval(ec_master_t* master, size_t send_interval)
+{
+	master -> send_interval = send_interval;
+	return 0;
+}
+
+int ecrt_master_activate(ec_master_t* master)
+{
+	int i;
+	ec_domain_t* domain;
+
+	if(master -> active)
+		return -EBUSY;
+
+	for(i = 0; i < master -> domain_count; i++)
+	{
+		domain = master -> domain_list[i];
+		domain -> data = (uint8_t*)calloc(domain -> size ? domain -> size : 1, 1);
+		if(domain -> data == NULL)
+			return -ENOMEM;
+	}
+
+	for(i = 0; i < slave_count; i++)
+	{
+		if(master -> config_list[i] != NULL)
+			slave_list[i].info.al_state = 0x08;
+	}
+
+	master -> active = 1;
+
+	return 0;
+}
+
+void ecrt_master_send(ec_master_t* master)
+{
+	int i, j;
+	ec_domain_t* domain;
+	ec_sdo_request_t* req;
+	size_t interval = master -> send_interval ? master -> send_interval : SIM_DEFAULT_INTERVAL;
+
+	if(!master -> active)
+		return;
+
+	/* outputs of queued domains reach the devices */
+	for(i = 0; i < master -> domain_count; i++)
+	{
+		domain = master -> domain_list[i];
+		if(!domain -> queued)
+			continue;
+
+		if(devices_enabled)
+		{
+			for(j = 0; j < domain -> region_count; j++)
+			{
+				if(domain -> region_list[j].config -> sync_list[domain -> region_list[j].sync].dir == EC_DIR_OUTPUT &&
+					region_wc(&(domain -> region_list[j])) == 2)
+					transfer_region(domain, &(domain -> region_list[j]), 1);
+			}
+		}
+
+		domain -> queued = 0;
+		domain -> in_flight = 1;
+	}
+
+	bus_cycle++;
+
+	/* the reference clock runs freely between synchronisations */
+	if(master -> reference_time != 0)
+	{
+		master -> drift_residue += (int64_t)interval * dc_drift_ppb;
+		master -> reference_time += interval + master -> drift_residue / 1000000000LL;
+		master -> drift_residue %= 1000000000LL;
+	}
+
+	/* mailbox transfers run whether the devices are enabled or not */
+	for(i = 0; sdo_busy_count != 0 && i < slave_count; i++)
+	{
+		if(master -> config_list[i] == NULL)
+			continue;
+
+		for(req = master -> config_list[i] -> sdo_request_list; req != NULL; req = req -> next)
+		{
+			if(req -> state == EC_REQUEST_BUSY && bus_cycle >= req -> due_cycle)
+				run_sdo(req);
+		}
+	}
+
+	if(!devices_enabled)
+		return;
+
+	for(i = 0; i < slave_count; i++)
+	{
+		if(master -> config_list[i] == NULL)
+			continue;
+
+		if(slave_list[i].model == ECRT_SIM_CIA402)
+			run_cia402(&slave_list[i], interval);
+		else
+			run_digital_input(&slave_list[i]);
+	}
+}
+
+void ecrt_master_receive(ec_master_t* master)
+{
+	int i, j;
+	ec_domain_t* domain;
+
+	if(!master -> active)
+		return;
+
+	/* inputs of in-flight domains return from the devices */
+	for(i = 0; i < master -> domain_count; i++)
+	{
+		domain = master -> domain_list[i];
+		if(!domain -> in_flight)
+			continue;
+
+		if(devices_enabled)
+		{
+			for(j = 0; j < domain -> region_count; j++)
+			{
+				if(domain -> region_list[j].config -> sync_list[domain -> region_list[j].sync].dir == EC_DIR_INPUT &&
+					region_wc(&(domain -> region_list[j])) != 0)
+					transfer_region(domain, &(domain -> region_list[j]), 0);
+			}
+		}
+
+		domain -> received_wc = 0;
+		for(j = 0; j < domain -> region_count; j++)
+			domain -> received_wc += region_wc(&(domain -> region_list[j]));
+		domain -> in_flight = 0;
+	}
+}
+
+void ecrt_master_state(const ec_master_t* master, ec_master_state_t* state)
+{
+	int i;
+
+	memset(state, 0, sizeof(ec_master_state_t));
+	state -> link_up = 1;
+
+	for(i = 0; i < slave_count; i++)
+	{
+		if(slave_list[i].offline)
+			continue;
+		state -> slaves_responding++;
+		state -> al_states |= slave_list[i].info.al_state & 0x0f;
+	}
+}
+
+void ecrt_master_application_time(ec_master_t* master, uint64_t app_time)
+{
+	master -> app_time = app_time;
+	if(master -> reference_time == 0)
+		master -> reference_time = app_time;
+}
+
+void ecrt_master_sync_reference_clock(ec_master_t* master)
+{
+	master -> reference_time = master -> app_time;
+	master -> drift_residue = 0;
+}
+
+void ecrt_master_sync_slave_clocks(ec_master_t* master)
+{
+	/* the datagram carries the reference clock time of this cycle */
+	master -> latched_time = master -> reference_time;
+}
+
+int ecrt_master_reference_clock_time(ec_master_t* master, uint32_t* time)
+{
+	if(master -> latched_time == 0)
+		return -ENXIO;
+
+	*time = (uint32_t)master -> latched_time;
+	return 0;
+}
+
+/* slave configuration */
+
+int ecrt_slave_config_pdos(ec_slave_config_t* sc, unsigned int n_syncs, const ec_sync_info_t syncs[])
+{
+	unsigned int i, j, k;
+	ec_sync_info_t* target;
+
+	if(sim_master == NULL || sim_master -> active)
+		return -EBUSY;
+
+	for(i = 0; n_syncs == EC_END ? syncs[i].index != 0xff : i < n_syncs; i++)
+	{
+		if(syncs[i].index >= sc -> slave -> info.sync_count)
+			return -ENOENT;
+
+		/* only objects known to the device can be mapped */
+		for(j = 0; j < syncs[i].n_pdos; j++)
+		{
+			for(k = 0; k < syncs[i].pdos[j].n_entries; k++)
+			{
+				if(syncs[i].pdos[j].entries[k].index != 0 &&
+					find_object(sc -> slave, syncs[i].pdos[j].entries[k].index, syncs[i].pdos[j].entries[k].subindex) == NULL)
+					return -ENOENT;
+			}
+		}
+
+		target = &(sc -> sync_list[syncs[i].index]);
+		if(sc -> sync_domain[syncs[i].index] != NULL)
+			return -EBUSY;
+
+		free_sync_list(target);
+		memset(target, 0, sizeof(ec_sync_info_t));
+		if(copy_sync_list(target, &syncs[i], 1) != 0)
+			return -ENOMEM;
+		target -> index = syncs[i].index;
+	}
+
+	return 0;
+}
+
+void ecrt_slave_config_dc(ec_slave_config_t* sc, uint16_t assign_activate, uint32_t sync0_cycle,
+	int32_t sync0_shift, uint32_t sync1_cycle, int32_t sync1_shift)
+{
+	sc -> dc_assign_activate = assign_activate;
+	sc -> dc_sync0_cycle = sync0_cycle;
+	sc -> dc_sync0_shift = sync0_shift;
+}
+
+void ecrt_slave_config_state(const ec_slave_config_t* sc, ec_slave_config_state_t* state)
+{
+	memset(state, 0, sizeof(ec_slave_config_state_t));
+	if(sc -> slave -> offline)
+		return;
+
+	state -> online = 1;
+	state -> al_state = sc -> slave -> info.al_state;
+	state -> operational = sc -> slave -> info.al_state == 0x08;
+}
+
+ec_sdo_request_t* ecrt_slave_config_create_sdo_request(ec_slave_config_t* sc, uint16_t index,
+	uint8_t subindex, size_t size)
+{
+	ec_sdo_request_t* req;
+
+	if(sim_master == NULL || sim_master -> active)
+		return NULL;
+
+	req = (ec_sdo_request_t*)calloc(1, sizeof(ec_sdo_request_t));
+	if(req == NULL)
+		return NULL;
+
+	req -> data = (uint8_t*)calloc(size ? size : 1, 1);
+	if(req -> data == NULL)
+	{
+		free(req);
+		return NULL;
+	}
+
+	/* like the master, a request keeps its size until a read changes it */
+	req -> config = sc;
+	req -> index = index;
+	req -> subindex = subindex;
+	req -> size = size;
+	req -> data_size = size;
+	req -> state = EC_REQUEST_UNUSED;
+
+	req -> next = sc -> sdo_request_list;
+	sc -> sdo_request_list = req;
+
+	return req;
+}
+
+/* SDO request */
+
+void ecrt_sdo_request_index(ec_sdo_request_t* req, uint16_t index, uint8_t subindex)
+{
+	req -> index = index;
+	req -> subindex = subindex;
+}
+
+void ecrt_sdo_request_timeout(ec_sdo_request_t* req, uint32_t timeout)
+{
+	req -> timeout = timeout;
+}
+
+uint8_t* ecrt_sdo_request_data(ec_sdo_request_t* req)
+{
+	return req -> data;
+}
+
+size_t ecrt_sdo_request_data_size(const ec_sdo_request_t* req)
+{
+	return req -> data_size;
+}
+
+ec_request_state_t ecrt_sdo_request_state(ec_sdo_request_t* req)
+{
+	return req -> state;
+}
+
+void ecrt_sdo_request_write(ec_sdo_request_t* req)
+{
+	if(req -> state != EC_REQUEST_BUSY)
+		sdo_busy_count++;
+	req -> write = 1;
+	req -> state = EC_REQUEST_BUSY;
+	req -> due_cycle = bus_cycle + SIM_SDO_CYCLES;
+}
+
+void ecrt_sdo_request_read(ec_sdo_request_t* req)
+{
+	if(req -> state != EC_REQUEST_BUSY)
+		sdo_busy_count++;
+	req -> write = 0;
+	req -> state = EC_REQUEST_BUSY;
+	req -> due_cycle = bus_cycle + SIM_SDO_CYCLES;
+}
+
+/* domain */
+
+int ecrt_domain_reg_pdo_entry_list(ec_domain_t* domain, const ec_pdo_entry_reg_t* pdo_entry_regs)
+{
+	const ec_pdo_entry_reg_t* reg;
+	ec_slave_config_t* config;
+	ec_sync_info_t* sync;
+	sim_region_t* region;
+	sim_region_t* new_list;
+	unsigned int i, j, k, bit_offset;
+	int found, r;
+
+	if(sim_master == NULL || sim_master -> active)
+		return -EBUSY;
+
+	for(reg = pdo_entry_regs; reg -> index != 0; reg++)
+	{
+		config = ecrt_master_slave_config(sim_master, reg -> alias, reg -> position, reg -> vendor_id, reg -> product_code);
+		if(config == NULL)
+			return -ENOENT;
+
+		/* locate entry within the configured sync managers */
+		found = 0;
+		for(i = 0; i < config -> slave -> info.sync_count && !found; i++)
+		{
+			sync = &(config -> sync_list[i]);
+			bit_offset = 0;
+			for(j = 0; j < sync -> n_pdos && !found; j++)
+			{
+				for(k = 0; k < sync -> pdos[j].n_entries; k++)
+				{
+					if(sync -> pdos[j].entries[k].index == reg -> index &&
+						sync -> pdos[j].entries[k].subindex == reg -> subindex)
+					{
+						found = 1;
+						break;
+					}
+					bit_offset += sync -> pdos[j].entries[k].bit_length;
+				}
+			}
+		}
+		if(!found)
+			return -ENOENT;
+		i--;
+
+		if(config -> sync_domain[i] != NULL && config -> sync_domain[i] != domain)
+			return -EEXIST;
+
+		/* the whole sync manager is placed in the domain once */
+		region = NULL;
+		for(r = 0; r < domain -> region_count; r++)
+		{
+			if(domain -> region_list[r].config == config && domain -> region_list[r].sync == (int)i)
+				region = &(domain -> region_list[r]);
+		}
+
+		if(region == NULL)
+		{
+			new_list = (sim_region_t*)realloc(domain -> region_list, sizeof(sim_region_t) * (domain -> region_count + 1));
+			if(new_list == NULL)
+				return -ENOMEM;
+			domain -> region_list = new_list;
+
+			region = &(domain -> region_list[domain -> region_count++]);
+			region -> config = config;
+			region -> sync = i;
+			region -> offset = domain -> size;
+			region -> size = (sync_bit_length(&(config -> sync_list[i])) + 7) / 8;
+
+			domain -> size += region -> size;
+			domain -> expected_wc += config -> sync_list[i].dir == EC_DIR_OUTPUT ? 2 : 1;
+			config -> sync_domain[i] = domain;
+		}
+
+		if(reg -> bit_position != NULL)
+			*(reg -> bit_position) = bit_offset % 8;
+		else if(bit_offset % 8 != 0)
+			return -EFAULT;
+		*(reg -> offset) = region -> offset + bit_offset / 8;
+	}
+
+	return 0;
+}
+
+size_t ecrt_domain_size(const ec_domain_t* domain)
+{
+	return domain -> size;
+}
+
+uint8_t* ecrt_domain_data(ec_domain_t* domain)
+{
+	return domain -> data;
+}
+
+void ecrt_domain_process(ec_domain_t* domain)
+{
+	domain -> working_counter = domain -> received_wc;
+	domain -> received_wc = 0;
+}
+
+void ecrt_domain_queue(ec_domain_t* domain)
+{
+	domain -> queued = 1;
+}
+
+void ecrt_domain_state(const ec_domain_t* domain, ec_domain_state_t* state)
+{
+	memset(state, 0, sizeof(ec_domain_state_t));
+	state -> working_counter = domain -> working_counter;
+
+	if(domain -> working_counter == 0)
+		state -> wc_state = EC_WC_ZERO;
+	else if(domain -> working_counter == domain -> expected_wc)
+		state -> wc_state = EC_WC_COMPLETE;
+	else
+		state -> wc_state = EC_WC_INCOMPLETE;
+}
+
+/* internals */
+
+static int copy_sync_list(ec_sync_info_t* dst, const ec_sync_info_t* src, unsigned int sync_count)
+{
+	unsigned int i, j;
+
+	for(i = 0; i < sync_count; i++)
+	{
+		dst[i] = src[i];
+		dst[i].pdos = NULL;
+		if(src[i].n_pdos == 0)
+			continue;
+
+		dst[i].pdos = (ec_pdo_info_t*)calloc(src[i].n_pdos, sizeof(ec_pdo_info_t));
+		if(dst[i].pdos == NULL)
+			return 1;
+
+		for(j = 0; j < src[i].n_pdos; j++)
+		{
+			dst[i].pdos[j] = src[i].pdos[j];
+			dst[i].pdos[j].entries = NULL;
+			if(src[i].pdos[j].n_entries == 0)
+				continue;
+
+			dst[i].pdos[j].entries = (ec_pdo_entry_info_t*)malloc(sizeof(ec_pdo_entry_info_t) * src[i].pdos[j].n_entries);
+			if(dst[i].pdos[j].entries == NULL)
+				return 1;
+			memcpy(dst[i].pdos[j].entries, src[i].pdos[j].entries, sizeof(ec_pdo_entry_info_t) * src[i].pdos[j].n_entries);
+		}
+	}
+
+	return 0;
+}
+
+static void free_sync_list(ec_sync_info_t* sync_list)
+{
+	int i;
+	unsigned int j;
+
+	for(i = 0; i < SIM_MAX_SYNCS; i++)
+	{
+		if(sync_list[i].pdos == NULL)
+			continue;
+
+		for(j = 0; j < sync_list[i].n_pdos; j++)
+			free(sync_list[i].pdos[j].entries);
+		free(sync_list[i].pdos);
+		sync_list[i].pdos = NULL;
+	}
+}
+
+static int add_object(sim_slave_t* slave, const ec_pdo_entry_info_t* entry)
+{
+	sim_object_t* new_list;
+
+	/* gaps are not objects */
+	if(entry -> index == 0 || find_object(slave, entry -> index, entry -> subindex) != NULL)
+		return 0;
+
+	new_list = (sim_object_t*)realloc(slave -> object_list, sizeof(sim_object_t) * (slave -> object_count + 1));
+	if(new_list == NULL)
+		return 1;
+	slave -> object_list = new_list;
+
+	slave -> object_list[slave -> object_count].index = entry -> index;
+	slave -> object_list[slave -> object_count].subindex = entry -> subindex;
+	slave -> object_list[slave -> object_count].bit_length = entry -> bit_length;
+	slave -> object_list[slave -> object_count].value = 0;
+	slave -> object_count++;
+
+	return 0;
+}
+
+static sim_object_t* find_object(sim_slave_t* slave, uint16_t index, uint8_t subindex)
+{
+	int i;
+
+	for(i = 0; i < slave -> object_count; i++)
+	{
+		if(slave -> object_list[i].index == index && slave -> object_list[i].subindex == subindex)
+			return &(slave -> object_list[i]);
+	}
+
+	return NULL;
+}
+
+static int64_t read_bits(const uint8_t* data, unsigned int bit_offset, unsigned int bit_length)
+{
+	unsigned int i;
+	uint64_t value = 0;
+
+	if(bit_offset % 8 == 0 && bit_length % 8 == 0)
+	{
+		for(i = 0; i < bit_length / 8; i++)
+			value |= (uint64_t)data[bit_offset / 8 + i] << (i * 8);
+		return (int64_t)value;
+	}
+
+	for(i = 0; i < bit_length; i++)
+	{
+		if(data[(bit_offset + i) / 8] & (1 << ((bit_offset + i) % 8)))
+			value |= 1ULL << i;
+	}
+
+	return (int64_t)value;
+}
+
+static void write_bits(uint8_t* data, unsigned int bit_offset, unsigned int bit_length, int64_t value)
+{
+	unsigned int i;
+
+	if(bit_offset % 8 == 0 && bit_length % 8 == 0)
+	{
+		for(i = 0; i < bit_length / 8; i++)
+			data[bit_offset / 8 + i] = (uint8_t)((uint64_t)value >> (i * 8));
+		return;
+	}
+
+	for(i = 0; i < bit_length; i++)
+	{
+		if((uint64_t)value & (1ULL << i))
+			data[(bit_offset + i) / 8] |= 1 << ((bit_offset + i) % 8);
+		else
+			data[(bit_offset + i) / 8] &= ~(1 << ((bit_offset + i) % 8));
+	}
+}
+
+static unsigned int sync_bit_length(const ec_sync_info_t* sync)
+{
+	unsigned int i, j;
+	unsigned int bit_length = 0;
+
+	for(i = 0; i < sync -> n_pdos; i++)
+	{
+		for(j = 0; j < sync -> pdos[i].n_entries; j++)
+			bit_length += sync -> pdos[i].entries[j].bit_length;
+	}
+
+	return bit_length;
+}
+
+static void transfer_region(ec_domain_t* domain, sim_region_t* region, int to_objects)
+{
+	unsigned int i, j;
+	unsigned int bit_offset = region -> offset * 8;
+	ec_sync_info_t* sync = &(region -> config -> sync_list[region -> sync]);
+	ec_pdo_entry_info_t* entry;
+	sim_object_t* object;
+
+	for(i = 0; i < sync -> n_pdos; i++)
+	{
+		for(j = 0; j < sync -> pdos[i].n_entries; j++)
+		{
+			entry = &(sync -> pdos[i].entries[j]);
+			object = find_object(region -> config -> slave, entry -> index, entry -> subindex);
+			if(object != NULL)
+			{
+				if(to_objects)
+					object -> value = read_bits(domain -> data, bit_offset, entry -> bit_length);
+				else
+					write_bits(domain -> data, bit_offset, entry -> bit_length, object -> value);
+			}
+			bit_offset += entry -> bit_length;
+		}
+	}
+}
+
+static int64_t get_value(sim_slave_t* slave, uint16_t index)
+{
+	sim_object_t* object = find_object(slave, index, 0);
+	return object == NULL ? 0 : object -> value;
+}
+
+static void set_value(sim_slave_t* slave, uint16_t index, int64_t value)
+{
+	sim_object_t* object = find_object(slave, index, 0);
+	if(object != NULL)
+		object -> value = value;
+}
+
+static void run_cia402(sim_slave_t* slave, size_t interval)
+{
+	int cw = (uint16_t)get_value(slave, OBJ_CONTROL_WORD);
+	int mode = (int8_t)get_value(slave, OBJ_MODE);
+	int32_t position = (int32_t)get_value(slave, OBJ_ACTUAL_POSITION);
+	int32_t target = (int32_t)get_value(slave, OBJ_TARGET_POSITION);
+	int32_t velocity = (int32_t)get_value(slave, OBJ_TARGET_VELOCITY);
+	int32_t next_position = position;
+
+	/* power drive state machine */
+	if(slave -> state == STATE_FAULT)
+	{
+		if((cw & 0x80) && !(slave -> last_control_word & 0x80))
+			slave -> state = STATE_SWITCH_ON_DISABLED;
+	}
+	else if((cw & 0x02) == 0)
+		slave -> state = STATE_SWITCH_ON_DISABLED;
+	else if((cw & 0x87) == 0x06)
+		slave -> state = STATE_READY_TO_SWITCH_ON;
+	else if((cw & 0x87) == 0x07 && slave -> state == STATE_READY_TO_SWITCH_ON)
+		slave -> state = STATE_SWITCHED_ON;
+	else if((cw & 0x8f) == 0x07 && slave -> state == STATE_OPERATION_ENABLED)
+		slave -> state = STATE_SWITCHED_ON;
+	else if((cw & 0x8f) == 0x0f && slave -> state == STATE_SWITCHED_ON)
+		slave -> state = STATE_OPERATION_ENABLED;
+	slave -> last_control_word = cw;
+
+	set_value(slave, OBJ_STATUS_WORD, slave -> state | SW_VOLTAGE_ENABLED);
+	set_value(slave, OBJ_MODE_DISPLAY, mode);
+
+	if(slave -> state != STATE_OPERATION_ENABLED)
+	{
+		set_value(slave, OBJ_ACTUAL_VELOCITY, 0);
+		set_value(slave, OBJ_ACTUAL_TORQUE, 0);
+		return;
+	}
+
+	/* ideal axis following the cyclic setpoint */
+	switch(mode)
+	{
+		case 8 :
+			next_position = target;
+			break;
+		case 9 :
+			next_position = position + (int32_t)((int64_t)velocity * (int64_t)interval / 1000000000LL);
+			break;
+		case 10 :
+			set_value(slave, OBJ_ACTUAL_TORQUE, get_value(slave, OBJ_TARGET_TORQUE));
+			break;
+	}
+
+	set_value(slave, OBJ_ACTUAL_VELOCITY,
+		(int32_t)((int64_t)(next_position - position) * 1000000000LL / (int64_t)interval));
+	set_value(slave, OBJ_ACTUAL_POSITION, next_position);
+	set_value(slave, OBJ_FOLLOWING_ERROR, mode == 8 ? 0 : target - next_position);
+}
+
+static void run_digital_input(sim_slave_t* slave)
+{
+	int i;
+
+	/* input channels count the bus cycles */
+	for(i = 0; i < slave -> object_count; i++)
+	{
+		if(slave -> sync_list[0].dir == EC_DIR_INPUT && slave -> object_list[i].bit_length == 1)
+			slave -> object_list[i].value = (bus_cycle >> i) & 1;
+	}
+}
+
+static void free_config(ec_slave_config_t* config)
+{
+	ec_sdo_request_t* req;
+
+	while(config -> sdo_request_list != NULL)
+	{
+		req = config -> sdo_request_list;
+		config -> sdo_request_list = req -> next;
+		if(req -> state == EC_REQUEST_BUSY)
+			sdo_busy_count--;
+		free(req -> data);
+		free(req);
+	}
+
+	free_sync_list(config -> sync_list);
+	free(config);
+}
+
+/* working counter increment of a region : outputs are only written in OP */
+static unsigned int region_wc(const sim_region_t* region)
+{
+	const sim_slave_t* slave = region -> config -> slave;
+
+	if(slave -> offline)
+		return 0;
+	if(region -> config -> sync_list[region -> sync].dir != EC_DIR_OUTPUT)
+		return 1;
+
+	return slave -> info.al_state == 0x08 ? 2 : 0;
+}
+
+/* expedited transfer of a whole object, aborted on any size mismatch */
+static void run_sdo(ec_sdo_request_t* req)
+{
+	sim_slave_t* slave = req -> config -> slave;
+	sim_object_t* object = find_object(slave, req -> index, req -> subindex);
+	size_t size;
+
+	sdo_busy_count--;
+	req -> state = EC_REQUEST_ERROR;
+	if(object == NULL || slave -> offline)
+		return;
+
+	size = (object -> bit_length + 7) / 8;
+	if(req -> write)
+	{
+		if(req -> data_size != size)
+			return;
+		object -> value = read_bits(req -> data, 0, object -> bit_length);
+	}
+	else
+	{
+		if(size > req -> size)
+			return;
+		write_bits(req -> data, 0, object -> bit_length, object -> value);
+		req -> data_size = size;
+	}
+
+	req -> state = EC_REQUEST_SUCCESS;
+}
@@ -0,0 +1,49 @@
+#ifndef _ECRT_SIM_H
+#define _ECRT_SIM_H
+
+#include "ecrt.h"
+
+/* simulated EtherCAT bus
+
+	The topology is configured before ecrt_request_master() and is kept
+	across master requests, so io_init() can be repeated on the same bus.
+	Slaves are appended at the next position. Every slave has an object
+	table built from its PDO entries; on ecrt_master_send() the outputs of
+	queued domains are written to the objects, the device model runs and
+	the inputs are read back into the domains on ecrt_master_receive().
+*/
+#define ECRT_SIM_GENERIC 0
+#define ECRT_SIM_CIA402 1
+
+#define ECRT_SIM_VENDOR_ID 0x0000053c
+#define ECRT_SIM_CIA402_CODE 0x00001402
+#define ECRT_SIM_DI_CODE 0x00001000
+#define ECRT_SIM_DO_CODE 0x00002000
+
+int ecrt_sim_reset(void);
+int ecrt_sim_add_slave(uint32_t vendor_id, uint32_t product_code, const char* name, int model,
+	const ec_sync_info_t* sync_list, unsigned int sync_count);
+int ecrt_sim_add_cia402(int count);
+int ecrt_sim_add_digital_input(int count, int bit_count);
+int ecrt_sim_add_digital_output(int count, int bit_count);
+int ecrt_sim_slave_count(void);
+
+/* with devices disabled, send and receive only move the domain data */
+int ecrt_sim_set_devices(int enable);
+
+/* the reference clock runs off the master clock by drift_ppb per cycle */
+int ecrt_sim_set_dc_drift(int drift_ppb);
+
+/* object values of a slave as last sent or to be received, for checks */
+int ecrt_sim_read_object(int position, uint16_t index, uint8_t subindex, int64_t* value);
+int ecrt_sim_write_object(int position, uint16_t index, uint8_t subindex, int64_t value);
+
+/* slave faults
+
+	ecrt_sim_set_slave_state() forces the AL state of a slave until the
+	next activation, 0 takes it off the bus. Outputs only reach slaves in
+	OP and the working counter counts what the slaves actually processed.
+*/
+int ecrt_sim_set_slave_state(int position, int al_state);
+
+#endif
@@ -0,0 +1,79 @@
+/* prints a recorder file as CSV
+
+	usage : io_record_dump [-s] file
+		-s prints 8, 16 and 32 bit entries as signed values.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "recorder.h"
+
+int main(int argc, char* argv[])
+{
+	int c, r, opt, ret;
+	int sign = 0;
+	unsigned int bit_length;
+	uint32_t value;
+	recorder_reader_t reader;
+
+	while((opt = getopt(argc, argv, "s")) != -1)
+	{
+		switch(opt)
+		{
+			case 's' : sign = 1; break;
+			default :
+				fprintf(stderr, "usage : %s [-s] file\n", argv[0]);
+				return 1;
+		}
+	}
+	if(optind != argc - 1)
+	{
+		fprintf(stderr, "usage : %s [-s] file\n", argv[0]);
+		return 1;
+	}
+
+	if(recorder_open(&reader, argv[optind]) != 0)
+	{
+		fprintf(stderr, "%s : not a recorder file\n", argv[optind]);
+		return 1;
+	}
+
+	fprintf(stderr, "%llu rows, %llu dropped, interval %llu ns\n", (unsigned long long)reader.header.row_count,
+		(unsigned long long)reader.header.dropped, (unsigned long long)reader.header.interval);
+
+	printf("cycle");
+	for(c = 0; c < reader.header.column_count; c++)
+	{
+		printf(",%d:0x%x:0x%x", reader.entry_list[c].slave, reader.entry_list[c].index,
+			reader.entry_list[c].subindex);
+	}
+	printf("\n");
+
+	while((ret = recorder_read_block(&reader)) > 0)
+	{
+		for(r = 0; r < reader.row_count; r++)
+		{
+			printf("%llu", reader.cycle_list[r]);
+			for(c = 0; c < reader.header.column_count; c++)
+			{
+				value = reader.value_list[c][r];
+				bit_length = reader.entry_list[c].bit_length;
+				if(sign && (bit_length == 8 || bit_length == 16 || bit_length == 32))
+					printf(",%d", bit_length == 32 ? (int32_t)value : bit_length == 16 ? (int16_t)value : (int8_t)value);
+				else
+					printf(",%u", value);
+			}
+			printf("\n");
+		}
+	}
+
+	recorder_close(&reader);
+	if(ret < 0)
+	{
+		fprintf(stderr, "%s : corrupted block\n", argv[optind]);
+		return 1;
+	}
+
+	return 0;
+}